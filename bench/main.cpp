@@ -0,0 +1,334 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fmt/core.h>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "gpu_renderer.h"
+#include "renderer.h"
+#include "scenes.h"
+#include "world.h"
+
+// Renders a fixed set of scenes at fixed seeds and reports throughput as
+// JSON, one run per thread count, so results can be diffed across versions.
+// Besides the default scene it sweeps every procedural layout over a range
+// of sphere counts, recording build time and memory per sphere along with
+// rays per second.
+
+using Clock = std::chrono::steady_clock;
+
+// Scenes are generated one at a time, so the largest ones never coexist.
+struct BenchScene {
+  std::string name;
+  SceneLayout layout;
+  // 0 is the default scene.
+  uint32_t count;
+};
+
+struct BenchOptions {
+  uint32_t width = 320;
+  uint32_t height = 180;
+  uint32_t sampleCount = 8;
+  uint32_t maxSpheres = 1'000'000;
+  // Layouts to sweep; empty sweeps all of them.
+  std::vector<SceneLayout> layouts;
+  bool wavefront = false;
+  // Also render every scene through GpuRenderer and compare it to the CPU.
+  bool gpu = false;
+  std::string output;
+};
+
+double millisecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// FNV-1a over the resolved image; equal across thread counts and runs as
+// long as the renderer's output doesn't change.
+uint64_t checksum(const std::vector<uint32_t> &pixels) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (uint32_t pixel : pixels) {
+    hash = (hash ^ pixel) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+std::vector<uint32_t> threadCounts() {
+  uint32_t hardware = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<uint32_t> counts;
+  for (uint32_t n = 1; n < hardware; n *= 2) {
+    counts.push_back(n);
+  }
+  counts.push_back(hardware);
+  return counts;
+}
+
+// Renders the scene through GpuRenderer at the same size and sample count
+// and compares it to the CPU image. The two use different random sequences,
+// so equivalence is statistical: meanAbsDifference is the per-channel mean
+// absolute difference in linear radiance and shrinks with more samples.
+// Returns a JSON object, or null when no GPU backend is available.
+std::string benchGpu(const World &world, const BenchOptions &options,
+                     const std::vector<float> &cpuLinear,
+                     double cpuSamplesPerSecond) {
+#ifdef TINYTRACER_GPU
+  GpuRenderer gpu;
+  if (!gpu.open(world,
+                {.width = options.width,
+                 .height = options.height,
+                 .sampleCount = options.sampleCount},
+                nullptr)) {
+    return "null";
+  }
+
+  std::vector<float> gpuLinear(cpuLinear.size());
+
+  Clock::time_point start = Clock::now();
+  while (!gpu.done()) {
+    gpu.renderPass(world.camera);
+  }
+  // Reading back waits for every queued pass.
+  bool resolved = gpu.resolveLinear(gpuLinear.data());
+  double renderMs = millisecondsSince(start);
+
+  if (!resolved) {
+    return "null";
+  }
+
+  double difference = 0.0;
+  for (size_t i = 0; i < cpuLinear.size(); i++) {
+    difference += std::abs(cpuLinear[i] - gpuLinear[i]);
+  }
+  difference /= static_cast<double>(cpuLinear.size());
+
+  double samplesPerSecond = static_cast<double>(options.width) *
+                            options.height * options.sampleCount /
+                            (renderMs / 1000.0);
+
+  fmt::println(stderr, "  gpu: {:8.1f} ms, {:.1f}x the CPU, difference {:.4f}",
+               renderMs, samplesPerSecond / cpuSamplesPerSecond, difference);
+
+  return fmt::format("{{\"renderMs\": {:.3f}, \"samplesPerSecond\": {:.0f}, "
+                     "\"speedup\": {:.3f}, \"meanAbsDifference\": {:.6f}}}",
+                     renderMs, samplesPerSecond,
+                     samplesPerSecond / cpuSamplesPerSecond, difference);
+#else
+  (void)world;
+  (void)options;
+  (void)cpuLinear;
+  (void)cpuSamplesPerSecond;
+  return "null";
+#endif
+}
+
+bool parseUint(std::string_view text, uint32_t &value) {
+  auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+  return ec == std::errc{} && end == text.data() + text.size();
+}
+
+bool parseLayout(std::string_view text, std::vector<SceneLayout> &layouts) {
+  for (SceneLayout layout : sceneLayouts) {
+    if (text == sceneLayoutName(layout)) {
+      layouts.push_back(layout);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool parseOptions(int argc, char **argv, BenchOptions &options) {
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg = argv[i];
+
+    if (arg == "--wavefront") {
+      options.wavefront = true;
+      continue;
+    }
+
+    if (arg == "--gpu") {
+#ifdef TINYTRACER_GPU
+      options.gpu = true;
+      continue;
+#else
+      fmt::println(stderr, "--gpu needs a build configured with "
+                           "-DTINYTRACER_GPU=ON.");
+      return false;
+#endif
+    }
+
+    if (i + 1 >= argc) {
+      fmt::println(stderr,
+                   "Usage: RayTracerBench [--width N] [--height N] [--spp N] "
+                   "[--max-spheres N] [--layout name]... [--wavefront] "
+                   "[--gpu] "
+                   "[--output file.json]");
+      return false;
+    }
+
+    std::string_view value = argv[++i];
+    bool valid = true;
+
+    if (arg == "--width") {
+      valid = parseUint(value, options.width);
+    } else if (arg == "--height") {
+      valid = parseUint(value, options.height);
+    } else if (arg == "--spp") {
+      valid = parseUint(value, options.sampleCount);
+    } else if (arg == "--max-spheres") {
+      valid = parseUint(value, options.maxSpheres);
+    } else if (arg == "--layout") {
+      valid = parseLayout(value, options.layouts);
+    } else if (arg == "--output") {
+      options.output = value;
+    } else {
+      valid = false;
+    }
+
+    if (!valid) {
+      fmt::println(stderr, "Invalid option: {} {}", arg, value);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+int main(int argc, char **argv) {
+  BenchOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    return 1;
+  }
+
+  std::vector<SceneLayout> layouts = options.layouts;
+  if (layouts.empty()) {
+    layouts.assign(std::begin(sceneLayouts), std::end(sceneLayouts));
+  }
+
+  std::vector<BenchScene> scenes;
+  scenes.push_back({"default", SceneLayout::Random, 0});
+  for (SceneLayout layout : layouts) {
+    for (uint32_t count : {1'000u, 10'000u, 100'000u, 1'000'000u}) {
+      if (count <= options.maxSpheres) {
+        scenes.push_back(
+            {fmt::format("{}-{}", sceneLayoutName(layout), count), layout,
+             count});
+      }
+    }
+  }
+
+  std::vector<uint32_t> threads = threadCounts();
+  std::string json = fmt::format(
+      "{{\n  \"width\": {},\n  \"height\": {},\n  \"spp\": {},\n"
+      "  \"mode\": \"{}\",\n  \"hardwareThreads\": {},\n  \"scenes\": [",
+      options.width, options.height, options.sampleCount,
+      options.wavefront ? "wavefront" : "packet", threads.back());
+
+  for (size_t s = 0; s < scenes.size(); s++) {
+    const BenchScene &scene = scenes[s];
+    World world = scene.count == 0
+                      ? defaultScene()
+                      : generateScene(scene.layout, scene.count, 1);
+
+    Clock::time_point start = Clock::now();
+    world.build();
+    double buildMs = millisecondsSince(start);
+
+    size_t sphereBytes = world.spheres.capacity() * sizeof(Sphere);
+    size_t bvhBytes = world.bvh.memoryBytes();
+    double bytesPerSphere = static_cast<double>(sphereBytes + bvhBytes) /
+                            static_cast<double>(world.spheres.size());
+
+    fmt::println(stderr,
+                 "{}: {} spheres, BVH built in {:.1f} ms, {:.1f} bytes per "
+                 "sphere",
+                 scene.name, world.spheres.size(), buildMs, bytesPerSphere);
+
+    json += fmt::format(
+        "{}\n    {{\n      \"name\": \"{}\",\n"
+        "      \"spheres\": {},\n      \"bvhNodes\": {},\n"
+        "      \"buildMs\": {:.3f},\n      \"bvhBytes\": {},\n"
+        "      \"bytesPerSphere\": {:.1f},\n      \"runs\": [",
+        s ? "," : "", scene.name, world.spheres.size(), world.bvh.nodes.size(),
+        buildMs, bvhBytes, bytesPerSphere);
+
+    double baseline = 0.0;
+    double fastestSamplesPerSecond = 0.0;
+    std::vector<float> cpuLinear(options.width * options.height * 3);
+
+    for (size_t t = 0; t < threads.size(); t++) {
+      Renderer tracer{world,
+                      {.width = options.width,
+                       .height = options.height,
+                       .sampleCount = options.sampleCount,
+                       .adaptiveThreshold = 0.0f,
+                       .wavefront = options.wavefront,
+                       .threadCount = threads[t]}};
+
+      start = Clock::now();
+      while (!tracer.done()) {
+        tracer.renderPass();
+      }
+      double renderMs = millisecondsSince(start);
+
+      std::vector<uint32_t> pixels(options.width * options.height);
+      start = Clock::now();
+      tracer.resolve(pixels.data());
+      double resolveMs = millisecondsSince(start);
+
+      double seconds = renderMs / 1000.0;
+      double raysPerSecond = tracer.rays() / seconds;
+      if (t == 0) {
+        baseline = raysPerSecond;
+      }
+      fastestSamplesPerSecond =
+          std::max(fastestSamplesPerSecond, tracer.samples() / seconds);
+      if (t + 1 == threads.size()) {
+        tracer.resolveLinear(cpuLinear.data());
+      }
+
+      fmt::println(stderr, "  {:>3} threads: {:8.1f} ms, {:7.2f} Mrays/s",
+                   threads[t], renderMs, raysPerSecond / 1e6);
+
+      json += fmt::format(
+          "{}\n        {{\"threads\": {}, \"renderMs\": {:.3f}, "
+          "\"resolveMs\": {:.3f}, \"samples\": {}, \"rays\": {}, "
+          "\"raysPerSecond\": {:.0f}, \"samplesPerSecond\": {:.0f}, "
+          "\"speedup\": {:.3f}, \"checksum\": \"{:016x}\"}}",
+          t ? "," : "", threads[t], renderMs, resolveMs, tracer.samples(),
+          tracer.rays(), raysPerSecond, tracer.samples() / seconds,
+          raysPerSecond / baseline, checksum(pixels));
+    }
+
+    json += "\n      ]";
+
+    if (options.gpu) {
+      json += ",\n      \"gpu\": " +
+              benchGpu(world, options, cpuLinear, fastestSamplesPerSecond);
+    }
+
+    json += "\n    }";
+  }
+
+  json += "\n  ]\n}\n";
+
+  if (options.output.empty()) {
+    fmt::print("{}", json);
+    return 0;
+  }
+
+  std::FILE *file = std::fopen(options.output.c_str(), "w");
+  if (file == nullptr) {
+    fmt::println(stderr, "Failed to open {}", options.output);
+    return 1;
+  }
+  std::fputs(json.c_str(), file);
+  std::fclose(file);
+
+  return 0;
+}
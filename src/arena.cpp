@@ -0,0 +1,69 @@
+#include "arena.h"
+
+#include <algorithm>
+
+namespace {
+
+// Blocks come from operator new[], which only guarantees this much; larger
+// alignments are handled by padding inside the block.
+constexpr size_t baseAlignment = alignof(std::max_align_t);
+
+} // namespace
+
+Arena::Arena(size_t blockSize) : blockSize{blockSize} {}
+
+void *Arena::allocateBytes(size_t size, size_t alignment) {
+  while (true) {
+    if (current < blocks.size()) {
+      Block &block = blocks[current];
+      uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+      uintptr_t start = (base + offset + alignment - 1) & ~(alignment - 1);
+      size_t end = start - base + size;
+
+      if (end <= block.size) {
+        used += end - offset;
+        offset = end;
+        return reinterpret_cast<void *>(start);
+      }
+
+      if (current + 1 < blocks.size()) {
+        used += block.size - offset;
+        current++;
+        offset = 0;
+        continue;
+      }
+    }
+
+    if (!blocks.empty()) {
+      used += blocks[current].size - offset;
+      current++;
+    }
+    addBlock(std::max(blockSize, size + alignment + baseAlignment));
+    offset = 0;
+  }
+}
+
+void Arena::addBlock(size_t size) {
+  blocks.push_back({std::make_unique<std::byte[]>(size), size});
+}
+
+void Arena::reset() {
+  peak = std::max(peak, used);
+
+  if (blocks.size() > 1) {
+    blocks.clear();
+    addBlock(std::max(blockSize, peak));
+  }
+
+  current = 0;
+  offset = 0;
+  used = 0;
+}
+
+size_t Arena::capacity() const {
+  size_t total = 0;
+  for (const Block &block : blocks) {
+    total += block.size;
+  }
+  return total;
+}
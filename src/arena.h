@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator for transient per-tile and per-pass buffers. reset() frees
+// everything at once but keeps the memory; if a frame overflowed into extra
+// blocks they are merged into one block that fits the peak, so after the
+// first frames the steady state makes no heap allocations. Not thread safe:
+// give each worker its own.
+class Arena {
+public:
+  explicit Arena(size_t blockSize = 1 << 20);
+
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  Arena(Arena &&) = default;
+  Arena &operator=(Arena &&) = default;
+
+  // Uninitialized storage for count objects; only meant for trivial types.
+  template <typename T> T *allocate(size_t count) {
+    static_assert(std::is_trivially_copyable_v<T> &&
+                  std::is_trivially_destructible_v<T>);
+    return static_cast<T *>(allocateBytes(count * sizeof(T), alignof(T)));
+  }
+
+  void reset();
+
+  size_t capacity() const;
+
+private:
+  struct Block {
+    std::unique_ptr<std::byte[]> data;
+    size_t size;
+  };
+
+  void *allocateBytes(size_t size, size_t alignment);
+  void addBlock(size_t size);
+
+  std::vector<Block> blocks;
+  size_t blockSize;
+  size_t current = 0;
+  size_t offset = 0;
+  size_t used = 0;
+  size_t peak = 0;
+};
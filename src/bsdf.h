@@ -0,0 +1,186 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "profile.h"
+#include "random.h"
+#include "ray.h"
+#include "sampler.h"
+
+// Metals whose GGX alpha is below this are treated as perfect mirrors; the
+// distribution is too peaked to evaluate in floats by then.
+constexpr float minGgxAlpha = 1e-3f;
+
+// A direction drawn from a BSDF. weight is f * cos / pdf, the factor the
+// path throughput picks up; pdf is per solid angle and meaningless for a
+// delta lobe, which light sampling can never hit.
+struct BsdfSample {
+  glm::vec3 direction;
+  glm::vec3 weight;
+  float pdf;
+  bool delta;
+};
+
+inline float ggxAlpha(const Material &mat) {
+  return mat.roughness * mat.roughness;
+}
+
+inline bool isDelta(const Material &mat) {
+  return mat.kind() == MaterialKind::Metallic && ggxAlpha(mat) < minGgxAlpha;
+}
+
+inline glm::vec3 fresnelSchlick(const glm::vec3 &f0, float cosTheta) {
+  float m = glm::clamp(1.0f - cosTheta, 0.0f, 1.0f);
+  float m2 = m * m;
+  return f0 + (glm::vec3{1.0f} - f0) * (m2 * m2 * m);
+}
+
+inline float ggxD(float alpha, float cosH) {
+  float a2 = alpha * alpha;
+  float d = cosH * cosH * (a2 - 1.0f) + 1.0f;
+  return a2 / (glm::pi<float>() * d * d);
+}
+
+// Smith masking for one direction; the BSDF uses the separable product of
+// both directions' terms.
+inline float ggxG1(float alpha, float cosTheta) {
+  float a2 = alpha * alpha;
+  return 2.0f * cosTheta /
+         (cosTheta + glm::sqrt(a2 + (1.0f - a2) * cosTheta * cosTheta));
+}
+
+// GGX visible normal in the frame where the normal is +z (Heitz, "Sampling
+// the GGX Distribution of Visible Normals", JCGT 2018).
+inline glm::vec3 sampleGgxVisibleNormal(const glm::vec3 &wo, float alpha,
+                                        const glm::vec2 &u) {
+  glm::vec3 vh = glm::normalize(glm::vec3{alpha * wo.x, alpha * wo.y, wo.z});
+  float lengthSquared = vh.x * vh.x + vh.y * vh.y;
+  glm::vec3 t1 = lengthSquared > 0.0f
+                     ? glm::vec3{-vh.y, vh.x, 0.0f} / glm::sqrt(lengthSquared)
+                     : glm::vec3{1.0f, 0.0f, 0.0f};
+  glm::vec3 t2 = glm::cross(vh, t1);
+
+  float r = glm::sqrt(u.x);
+  float phi = glm::two_pi<float>() * u.y;
+  float p1 = r * glm::cos(phi);
+  float p2 = r * glm::sin(phi);
+  float s = 0.5f * (1.0f + vh.z);
+  p2 = (1.0f - s) * glm::sqrt(glm::max(0.0f, 1.0f - p1 * p1)) + s * p2;
+
+  glm::vec3 nh =
+      p1 * t1 + p2 * t2 +
+      glm::sqrt(glm::max(0.0f, 1.0f - p1 * p1 - p2 * p2)) * vh;
+  return glm::normalize(
+      glm::vec3{alpha * nh.x, alpha * nh.y, glm::max(0.0f, nh.z)});
+}
+
+// Lambertian: cosine-weighted, so the weight is just the albedo.
+inline BsdfSample sampleDiffuse(const Material &mat, const glm::vec3 &n,
+                                Sampler &sampler) {
+  glm::vec3 wi = glm::normalize(cosineHemisphere(n, sampler.next2D()));
+  float cosTheta = glm::max(0.0f, glm::dot(n, wi));
+  return {wi, mat.albedo, cosTheta * glm::one_over_pi<float>(), false};
+}
+
+// GGX conductor with Schlick Fresnel from the albedo. Sampling visible
+// normals leaves F * G1(wi) as the weight, which never exceeds one, so
+// rough metals cost no more variance than smooth ones. Directions that
+// end up below the surface get a zero weight and end the path.
+inline BsdfSample sampleMetallic(const Material &mat, const glm::vec3 &n,
+                                 const glm::vec3 &wo, Sampler &sampler) {
+  glm::vec2 u = sampler.next2D();
+  float cosO = glm::dot(n, wo);
+
+  if (isDelta(mat)) {
+    return {glm::reflect(-wo, n), fresnelSchlick(mat.albedo, cosO), 0.0f,
+            true};
+  }
+
+  if (cosO <= 0.0f) {
+    return {n, glm::vec3{0.0f}, 0.0f, false};
+  }
+
+  glm::vec3 tangent, bitangent;
+  orthonormalBasis(n, tangent, bitangent);
+  glm::vec3 local{glm::dot(wo, tangent), glm::dot(wo, bitangent), cosO};
+
+  float alpha = ggxAlpha(mat);
+  glm::vec3 h = sampleGgxVisibleNormal(local, alpha, u);
+  glm::vec3 hWorld = h.x * tangent + h.y * bitangent + h.z * n;
+  glm::vec3 wi = glm::normalize(glm::reflect(-wo, hWorld));
+
+  float cosI = glm::dot(n, wi);
+  float cosOH = glm::dot(wo, hWorld);
+  if (cosI <= 0.0f || cosOH <= 0.0f) {
+    return {wi, glm::vec3{0.0f}, 0.0f, false};
+  }
+
+  float pdf = ggxG1(alpha, cosO) * ggxD(alpha, h.z) / (4.0f * cosO);
+  return {wi, fresnelSchlick(mat.albedo, cosOH) * ggxG1(alpha, cosI), pdf,
+          false};
+}
+
+// wo points back along the incoming ray. Every kind draws exactly one 2D
+// sample; with World::sampleLight() also drawing the same count on every
+// surface, the sampler dimensions of later bounces don't depend on the
+// materials hit.
+template <MaterialKind kind>
+BsdfSample sampleBsdf(const Material &mat, const glm::vec3 &n,
+                      const glm::vec3 &wo, Sampler &sampler) {
+  PROFILE_SCOPE(Scatter);
+  PROFILE_COUNT(Bounces, 1);
+
+  if constexpr (kind == MaterialKind::Metallic) {
+    return sampleMetallic(mat, n, wo, sampler);
+  } else {
+    return sampleDiffuse(mat, n, sampler);
+  }
+}
+
+inline BsdfSample sampleBsdf(const Material &mat, const glm::vec3 &n,
+                             const glm::vec3 &wo, Sampler &sampler) {
+  if (mat.kind() == MaterialKind::Metallic) {
+    return sampleBsdf<MaterialKind::Metallic>(mat, n, wo, sampler);
+  }
+  return sampleBsdf<MaterialKind::Diffuse>(mat, n, wo, sampler);
+}
+
+// f * cos for light arriving from wi, and in pdf the density sampleBsdf()
+// would have drawn wi with. Zero for delta lobes.
+inline glm::vec3 evalBsdf(const Material &mat, const glm::vec3 &n,
+                          const glm::vec3 &wo, const glm::vec3 &wi,
+                          float &pdf) {
+  pdf = 0.0f;
+  float cosI = glm::dot(n, wi);
+  if (cosI <= 0.0f || isDelta(mat)) {
+    return glm::vec3{0.0f};
+  }
+
+  if (mat.kind() == MaterialKind::Diffuse) {
+    pdf = cosI * glm::one_over_pi<float>();
+    return mat.albedo * pdf;
+  }
+
+  float cosO = glm::dot(n, wo);
+  glm::vec3 h = glm::normalize(wo + wi);
+  float cosOH = glm::dot(wo, h);
+  if (cosO <= 0.0f || cosOH <= 0.0f) {
+    return glm::vec3{0.0f};
+  }
+
+  float alpha = ggxAlpha(mat);
+  float d = ggxD(alpha, glm::dot(n, h));
+  float g1 = ggxG1(alpha, cosO);
+  pdf = g1 * d / (4.0f * cosO);
+  return fresnelSchlick(mat.albedo, cosOH) * (d * g1 * ggxG1(alpha, cosI) /
+                                              (4.0f * cosO));
+}
+
+// Power heuristic with beta = 2 (Veach 1997) for combining two strategies
+// that drew one sample each.
+inline float powerHeuristic(float pdf, float otherPdf) {
+  float a = pdf * pdf;
+  float b = otherPdf * otherPdf;
+  return a + b > 0.0f ? a / (a + b) : 0.0f;
+}
@@ -0,0 +1,452 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <future>
+#include <thread>
+
+#include "profile.h"
+
+namespace {
+
+constexpr uint32_t binCount = 16;
+constexpr uint32_t maxLeafSize = simdWidth > 4 ? simdWidth : 4;
+
+// Cost of visiting a node relative to one leaf kernel pass, for the SAH.
+constexpr float traversalCost = 1.0f;
+
+// Bounds the traversal stack in Bvh::hit().
+constexpr uint32_t maxDepth = 64;
+
+// Subtrees at least this large get built on their own thread.
+constexpr uint32_t parallelThreshold = 16 * 1024;
+
+// Leaves are tested simdWidth spheres per kernel pass, so the SAH counts
+// passes rather than spheres on both sides of the split decision.
+float kernelPasses(uint32_t count) {
+  return static_cast<float>((count + simdWidth - 1) / simdWidth);
+}
+
+Aabb sphereBounds(const Sphere &sphere) {
+  glm::vec3 r{sphere.radius};
+  return Aabb{sphere.center - r, sphere.center + r};
+}
+
+float intersects(const Ray &ray, const glm::vec3 &invDir, const BvhNode &node,
+                 float maxT) {
+  glm::vec3 t0 = (node.min - ray.origin) * invDir;
+  glm::vec3 t1 = (node.max - ray.origin) * invDir;
+  glm::vec3 tNear = glm::min(t0, t1);
+  glm::vec3 tFar = glm::max(t0, t1);
+
+  float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+  float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, maxT));
+
+  return enter <= exit ? enter : std::numeric_limits<float>::infinity();
+}
+
+struct PacketSetup {
+  float invX[packetSize];
+  float invY[packetSize];
+  float invZ[packetSize];
+};
+
+// Nearest entry distance over the lanes that hit the node before their
+// current closest hit, or infinity when none of them do.
+float intersects(const RayPacket &packet, const PacketSetup &setup,
+                 const BvhNode &node, const PrimitiveHit (&hits)[packetSize]) {
+  float nearest = std::numeric_limits<float>::infinity();
+
+  for (uint32_t i = 0; i < packetSize; i++) {
+    float tx0 = (node.min.x - packet.originX[i]) * setup.invX[i];
+    float tx1 = (node.max.x - packet.originX[i]) * setup.invX[i];
+    float ty0 = (node.min.y - packet.originY[i]) * setup.invY[i];
+    float ty1 = (node.max.y - packet.originY[i]) * setup.invY[i];
+    float tz0 = (node.min.z - packet.originZ[i]) * setup.invZ[i];
+    float tz1 = (node.max.z - packet.originZ[i]) * setup.invZ[i];
+
+    float enter = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)),
+                           std::max(std::min(tz0, tz1), 0.0f));
+    float exit = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)),
+                          std::min(std::max(tz0, tz1), hits[i].t));
+
+    bool live = i < packet.count && enter <= exit;
+    nearest = live ? std::min(nearest, enter) : nearest;
+  }
+
+  return nearest;
+}
+
+} // namespace
+
+struct Bvh::Builder {
+  Bvh &bvh;
+  std::vector<Aabb> bounds;
+  std::atomic<uint32_t> nodesUsed{1};
+  uint32_t spawnDepth;
+
+  void refit(BvhNode &node) {
+    Aabb box;
+    for (uint32_t i = 0; i < node.count; i++) {
+      box.grow(bounds[bvh.primitives[node.first + i]]);
+    }
+    node.min = box.min;
+    node.max = box.max;
+  }
+
+  // Binned SAH split search over the centroid extent of the node.
+  void subdivide(uint32_t nodeIdx, uint32_t depth) {
+    BvhNode &node = bvh.nodes[nodeIdx];
+    refit(node);
+
+    if (node.count <= 1 || depth + 1 >= maxDepth) {
+      return;
+    }
+
+    Aabb centroids;
+    for (uint32_t i = 0; i < node.count; i++) {
+      const Aabb &box = bounds[bvh.primitives[node.first + i]];
+      centroids.grow((box.min + box.max) * 0.5f);
+    }
+
+    float bestCost = std::numeric_limits<float>::max();
+    int bestAxis = -1;
+    uint32_t bestSplit = 0;
+
+    for (int axis = 0; axis < 3; axis++) {
+      float lo = centroids.min[axis];
+      float extent = centroids.max[axis] - lo;
+      if (extent <= 0.0f) {
+        continue;
+      }
+
+      Aabb binBounds[binCount];
+      uint32_t binCounts[binCount] = {};
+      float scale = binCount / extent;
+
+      for (uint32_t i = 0; i < node.count; i++) {
+        const Aabb &box = bounds[bvh.primitives[node.first + i]];
+        float c = (box.min[axis] + box.max[axis]) * 0.5f;
+        uint32_t bin = std::min(binCount - 1, static_cast<uint32_t>((c - lo) * scale));
+        binCounts[bin]++;
+        binBounds[bin].grow(box);
+      }
+
+      float leftArea[binCount - 1];
+      uint32_t leftCount[binCount - 1];
+      Aabb box;
+      uint32_t count = 0;
+      for (uint32_t i = 0; i < binCount - 1; i++) {
+        count += binCounts[i];
+        box.grow(binBounds[i]);
+        leftCount[i] = count;
+        leftArea[i] = count ? box.area() : 0.0f;
+      }
+
+      box = Aabb{};
+      count = 0;
+      for (uint32_t i = binCount - 1; i > 0; i--) {
+        count += binCounts[i];
+        box.grow(binBounds[i]);
+        if (count == 0 || leftCount[i - 1] == 0) {
+          continue;
+        }
+
+        float cost = kernelPasses(leftCount[i - 1]) * leftArea[i - 1] +
+                     kernelPasses(count) * box.area();
+        if (cost < bestCost) {
+          bestCost = cost;
+          bestAxis = axis;
+          bestSplit = i;
+        }
+      }
+    }
+
+    Aabb nodeBox{node.min, node.max};
+    float leafCost = kernelPasses(node.count) * nodeBox.area();
+    float splitCost = traversalCost * nodeBox.area() + bestCost;
+
+    if (bestAxis < 0 || (node.count <= maxLeafSize && splitCost >= leafCost)) {
+      return;
+    }
+
+    float lo = centroids.min[bestAxis];
+    float scale = binCount / (centroids.max[bestAxis] - lo);
+
+    uint32_t *begin = bvh.primitives.data() + node.first;
+    uint32_t *mid = std::partition(begin, begin + node.count, [&](uint32_t p) {
+      const Aabb &box = bounds[p];
+      float c = (box.min[bestAxis] + box.max[bestAxis]) * 0.5f;
+      return std::min(binCount - 1, static_cast<uint32_t>((c - lo) * scale)) <
+             bestSplit;
+    });
+
+    uint32_t leftCount = static_cast<uint32_t>(mid - begin);
+    if (leftCount == 0 || leftCount == node.count) {
+      return;
+    }
+
+    uint32_t left = nodesUsed.fetch_add(2);
+    bvh.nodes[left] = {{}, node.first, {}, leftCount};
+    bvh.nodes[left + 1] = {{}, node.first + leftCount, {}, node.count - leftCount};
+    node.first = left;
+    node.count = 0;
+
+    if (depth < spawnDepth && leftCount >= parallelThreshold) {
+      std::future<void> task = std::async(std::launch::async, [=, this] {
+        subdivide(left, depth + 1);
+      });
+      subdivide(left + 1, depth + 1);
+      task.get();
+    } else {
+      subdivide(left, depth + 1);
+      subdivide(left + 1, depth + 1);
+    }
+  }
+};
+
+void Bvh::build(const std::vector<Sphere> &spheres) {
+  nodes.clear();
+  primitives.resize(spheres.size());
+
+  if (spheres.empty()) {
+    leaves.assign(spheres, primitives);
+    return;
+  }
+
+  for (uint32_t i = 0; i < primitives.size(); i++) {
+    primitives[i] = i;
+  }
+
+  // A binary tree over N leaves never needs more than 2N - 1 nodes.
+  nodes.resize(2 * spheres.size() - 1);
+  nodes[0] = {{}, 0, {}, static_cast<uint32_t>(spheres.size())};
+
+  uint32_t spawnDepth = 0;
+  while ((1u << spawnDepth) < std::thread::hardware_concurrency()) {
+    spawnDepth++;
+  }
+
+  Builder builder{*this, {}, {1}, spawnDepth};
+  builder.bounds.reserve(spheres.size());
+  for (const Sphere &sphere : spheres) {
+    builder.bounds.push_back(sphereBounds(sphere));
+  }
+
+  builder.subdivide(0, 0);
+
+  nodes.resize(builder.nodesUsed);
+  nodes.shrink_to_fit();
+
+  leaves.assign(spheres, primitives);
+}
+
+void Bvh::refit(const std::vector<Sphere> &spheres) {
+  if (nodes.empty() || primitives.size() != spheres.size()) {
+    build(spheres);
+    return;
+  }
+
+  leaves.assign(spheres, primitives);
+
+  // Children are always allocated after their parent, so a reverse sweep
+  // sees both children of a node before the node itself.
+  for (size_t i = nodes.size(); i-- > 0;) {
+    BvhNode &node = nodes[i];
+    Aabb box;
+
+    if (node.count > 0) {
+      for (uint32_t j = 0; j < node.count; j++) {
+        box.grow(sphereBounds(spheres[primitives[node.first + j]]));
+      }
+    } else {
+      box.grow(Aabb{nodes[node.first].min, nodes[node.first].max});
+      box.grow(Aabb{nodes[node.first + 1].min, nodes[node.first + 1].max});
+    }
+
+    node.min = box.min;
+    node.max = box.max;
+  }
+}
+
+bool Bvh::valid(uint32_t primitiveCount) const {
+  if (nodes.empty() != (primitiveCount == 0) ||
+      primitives.size() != primitiveCount) {
+    return false;
+  }
+  for (uint32_t primitive : primitives) {
+    if (primitive >= primitiveCount) {
+      return false;
+    }
+  }
+
+  // Children must come after their parent, which rules out cycles, and be
+  // referenced once, which rules out shared subtrees. Depths then follow
+  // from a single forward sweep.
+  std::vector<uint32_t> depth(nodes.size(), 0);
+  std::vector<uint8_t> referenced(nodes.size(), 0);
+  for (uint32_t i = 0; i < nodes.size(); i++) {
+    const BvhNode &node = nodes[i];
+    if (depth[i] >= maxDepth) {
+      return false;
+    }
+
+    if (node.count > 0) {
+      if (uint64_t{node.first} + node.count > primitiveCount) {
+        return false;
+      }
+      continue;
+    }
+
+    if (node.first <= i || uint64_t{node.first} + 1 >= nodes.size()) {
+      return false;
+    }
+    for (uint32_t child : {node.first, node.first + 1}) {
+      if (referenced[child]) {
+        return false;
+      }
+      referenced[child] = 1;
+      depth[child] = depth[i] + 1;
+    }
+  }
+  return true;
+}
+
+// Both queries share one traversal; each instantiation carries only its own
+// exit test.
+template <HitQuery query>
+PrimitiveHit Bvh::hit(const Ray &ray, float minT, float maxT) const {
+  PrimitiveHit record{maxT, noPrimitive};
+
+  if (nodes.empty()) {
+    return record;
+  }
+
+  glm::vec3 invDir = 1.0f / ray.direction;
+
+  uint32_t stack[maxDepth];
+  uint32_t stackSize = 0;
+  uint32_t nodeIdx = 0;
+
+  if (intersects(ray, invDir, nodes[0], record.t) ==
+      std::numeric_limits<float>::infinity()) {
+    return record;
+  }
+
+  while (true) {
+    const BvhNode &node = nodes[nodeIdx];
+
+    if (node.count > 0) {
+      PROFILE_COUNT(IntersectionTests, node.count);
+      PrimitiveHit leafHit =
+          leaves.nearest(ray, node.first, node.count, minT, record.t);
+      if (leafHit.index != noPrimitive) {
+        record = {leafHit.t, leaves.ids[leafHit.index]};
+        if constexpr (query == HitQuery::Any) {
+          return record;
+        }
+      }
+
+      if (stackSize == 0) {
+        break;
+      }
+      nodeIdx = stack[--stackSize];
+      continue;
+    }
+
+    // Visit the nearer child first and defer the other one; children whose
+    // box starts beyond the current closest hit are skipped entirely.
+    uint32_t near = node.first;
+    uint32_t far = node.first + 1;
+    float tNear = intersects(ray, invDir, nodes[near], record.t);
+    float tFar = intersects(ray, invDir, nodes[far], record.t);
+
+    if (tFar < tNear) {
+      std::swap(near, far);
+      std::swap(tNear, tFar);
+    }
+
+    if (tNear == std::numeric_limits<float>::infinity()) {
+      if (stackSize == 0) {
+        break;
+      }
+      nodeIdx = stack[--stackSize];
+      continue;
+    }
+
+    nodeIdx = near;
+    if (tFar != std::numeric_limits<float>::infinity()) {
+      stack[stackSize++] = far;
+    }
+  }
+
+  return record;
+}
+
+template PrimitiveHit Bvh::hit<HitQuery::Closest>(const Ray &, float,
+                                                  float) const;
+template PrimitiveHit Bvh::hit<HitQuery::Any>(const Ray &, float,
+                                              float) const;
+
+void Bvh::hit(const RayPacket &packet, float minT, float maxT,
+              PrimitiveHit (&hits)[packetSize]) const {
+  PacketSetup setup;
+  for (uint32_t i = 0; i < packetSize; i++) {
+    hits[i] = {maxT, noPrimitive};
+    setup.invX[i] = 1.0f / packet.directionX[i];
+    setup.invY[i] = 1.0f / packet.directionY[i];
+    setup.invZ[i] = 1.0f / packet.directionZ[i];
+  }
+
+  if (nodes.empty() || intersects(packet, setup, nodes[0], hits) ==
+                           std::numeric_limits<float>::infinity()) {
+    return;
+  }
+
+  uint32_t stack[maxDepth];
+  uint32_t stackSize = 0;
+  uint32_t nodeIdx = 0;
+
+  while (true) {
+    const BvhNode &node = nodes[nodeIdx];
+
+    if (node.count > 0) {
+      PROFILE_COUNT(IntersectionTests, node.count * packet.count);
+      for (uint32_t i = 0; i < packet.count; i++) {
+        PrimitiveHit leafHit = leaves.nearest(packet.ray(i), node.first,
+                                              node.count, minT, hits[i].t);
+        if (leafHit.index != noPrimitive) {
+          hits[i] = {leafHit.t, leaves.ids[leafHit.index]};
+        }
+      }
+
+      if (stackSize == 0) {
+        break;
+      }
+      nodeIdx = stack[--stackSize];
+      continue;
+    }
+
+    uint32_t near = node.first;
+    uint32_t far = node.first + 1;
+    float tNear = intersects(packet, setup, nodes[near], hits);
+    float tFar = intersects(packet, setup, nodes[far], hits);
+
+    if (tFar < tNear) {
+      std::swap(near, far);
+      std::swap(tNear, tFar);
+    }
+
+    if (tNear == std::numeric_limits<float>::infinity()) {
+      if (stackSize == 0) {
+        break;
+      }
+      nodeIdx = stack[--stackSize];
+      continue;
+    }
+
+    nodeIdx = near;
+    if (tFar != std::numeric_limits<float>::infinity()) {
+      stack[stackSize++] = far;
+    }
+  }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <limits>
+#include <vector>
+
+#include "packet.h"
+#include "ray.h"
+#include "spheres.h"
+
+struct Aabb {
+  glm::vec3 min{std::numeric_limits<float>::max()};
+  glm::vec3 max{-std::numeric_limits<float>::max()};
+
+  void grow(const glm::vec3 &p) {
+    min = glm::min(min, p);
+    max = glm::max(max, p);
+  }
+
+  void grow(const Aabb &box) {
+    min = glm::min(min, box.min);
+    max = glm::max(max, box.max);
+  }
+
+  float area() const {
+    glm::vec3 e = max - min;
+    return e.x * e.y + e.y * e.z + e.z * e.x;
+  }
+};
+
+// 32-byte node. Leaves (count > 0) cover slots [first, first + count) of
+// Bvh::leaves; interior nodes keep their two children side by side at
+// first, first + 1.
+struct BvhNode {
+  glm::vec3 min;
+  uint32_t first;
+  glm::vec3 max;
+  uint32_t count;
+};
+
+// Closest finds the nearest hit; Any stops at the first hit it finds, which
+// is all a shadow ray needs.
+enum class HitQuery { Closest, Any };
+
+struct Bvh {
+  std::vector<BvhNode> nodes;
+  std::vector<uint32_t> primitives;
+
+  // Sphere geometry in leaf order, so each leaf is one contiguous run for
+  // the SIMD kernel.
+  SphereSoA leaves;
+
+  void build(const std::vector<Sphere> &spheres);
+
+  // Bytes held by the nodes, the primitive order and the leaf copies.
+  size_t memoryBytes() const {
+    return nodes.capacity() * sizeof(BvhNode) +
+           primitives.capacity() * sizeof(uint32_t) +
+           (leaves.centerX.capacity() + leaves.centerY.capacity() +
+            leaves.centerZ.capacity() + leaves.radiusSquared.capacity()) *
+               sizeof(float) +
+           leaves.ids.capacity() * sizeof(uint32_t);
+  }
+
+  // Recomputes every box for moved or resized spheres while keeping the
+  // tree topology. Much cheaper than build(), but the tree degrades if
+  // spheres drift far from where they were when it was built.
+  void refit(const std::vector<Sphere> &spheres);
+
+  // Whether a tree read from a file over primitiveCount spheres is one
+  // build() could have made: indices in range, children after their parent
+  // and no deeper than the traversal stack. hit() and refit() check none of
+  // that themselves.
+  bool valid(uint32_t primitiveCount) const;
+
+  // Hit in (minT, maxT); index is into the spheres passed to build(), or
+  // noPrimitive on a miss. Instantiated for both queries in bvh.cpp.
+  template <HitQuery query = HitQuery::Closest>
+  PrimitiveHit hit(const Ray &ray, float minT, float maxT) const;
+
+  // Traces the live lanes of a packet together: a node is entered when any
+  // lane still hits its box, leaves are tested lane by lane.
+  void hit(const RayPacket &packet, float minT, float maxT,
+           PrimitiveHit (&hits)[packetSize]) const;
+
+private:
+  struct Builder;
+};
@@ -0,0 +1,73 @@
+#include "checkpoint.h"
+
+#include <filesystem>
+#include <fmt/core.h>
+#include <system_error>
+#include <utility>
+
+Checkpoint::Checkpoint(std::string path, std::chrono::milliseconds interval)
+    : path{std::move(path)}, interval{interval},
+      lastWrite{std::chrono::steady_clock::now()} {}
+
+Checkpoint::~Checkpoint() {
+  if (writer.joinable()) {
+    writer.join();
+  }
+}
+
+bool Checkpoint::resume(Renderer &renderer) {
+  std::error_code error;
+  if (!std::filesystem::exists(path, error)) {
+    return true;
+  }
+
+  if (!resumePartial(path, renderer)) {
+    return false;
+  }
+
+  fmt::println("Resumed from {} after {} passes", path, renderer.passes());
+  return true;
+}
+
+void Checkpoint::update(const Renderer &renderer) {
+  auto now = std::chrono::steady_clock::now();
+  if (now - lastWrite < interval || writing) {
+    return;
+  }
+
+  if (writer.joinable()) {
+    writer.join();
+  }
+
+  snapshotPartial(renderer, snapshot);
+  lastWrite = now;
+  writing = true;
+  writer = std::thread{[this] {
+    write();
+    writing = false;
+  }};
+}
+
+bool Checkpoint::finish(const Renderer &renderer) {
+  if (writer.joinable()) {
+    writer.join();
+  }
+
+  snapshotPartial(renderer, snapshot);
+  return write();
+}
+
+bool Checkpoint::write() {
+  std::string temporary = path + ".tmp";
+  if (!writePartial(temporary, snapshot)) {
+    return false;
+  }
+
+  std::error_code error;
+  std::filesystem::rename(temporary, path, error);
+  if (error) {
+    fmt::println("Failed to replace {}: {}", path, error.message());
+    return false;
+  }
+  return true;
+}
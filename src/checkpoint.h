@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "partial_file.h"
+#include "renderer.h"
+
+// Periodic checkpoints of a headless render, as .ttp partials. Sample k of
+// a pixel is seeded from (pixel, k) alone, so the sums, sample counts,
+// denoiser guide sums and pass count are all the state there is; a resumed
+// render of the same scene with the same sampling settings continues with
+// exactly the samples the interrupted one would have drawn next.
+//
+// update() copies the sums between passes and hands the copy to a
+// background thread, which writes path.tmp and renames it over path, so a
+// kill at any point leaves the previous checkpoint intact and the workers
+// only wait for the copy.
+class Checkpoint {
+public:
+  Checkpoint(std::string path, std::chrono::milliseconds interval);
+  ~Checkpoint();
+
+  Checkpoint(const Checkpoint &) = delete;
+  Checkpoint &operator=(const Checkpoint &) = delete;
+
+  // Continues renderer from path if there is a checkpoint there. Fails only
+  // when the file exists but can't be resumed from.
+  bool resume(Renderer &renderer);
+
+  // Call between passes. Starts a write once interval has passed since the
+  // last one, unless that one is still in progress.
+  void update(const Renderer &renderer);
+
+  // Waits for a pending write, then writes the finished render.
+  bool finish(const Renderer &renderer);
+
+private:
+  bool write();
+
+  std::string path;
+  std::chrono::milliseconds interval;
+  std::chrono::steady_clock::time_point lastWrite;
+
+  PartialSnapshot snapshot;
+  std::thread writer;
+  std::atomic<bool> writing{false};
+};
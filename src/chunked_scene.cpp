@@ -0,0 +1,425 @@
+#include "chunked_scene.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fmt/core.h>
+#include <limits>
+#include <numeric>
+#include <utility>
+
+static_assert(sizeof(ChunkFileHeader) == 80);
+static_assert(sizeof(ChunkEntry) == 64);
+
+namespace {
+
+constexpr uint64_t sectionAlignment = 64;
+
+// Matches the traversal stack bound in bvh.cpp.
+constexpr uint32_t maxDepth = 64;
+
+uint64_t alignUp(uint64_t offset, uint64_t alignment) {
+  return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+// Tracks the offset itself rather than asking ftell(), whose long is 32
+// bits on some platforms and these files are meant to be large.
+struct FileWriter {
+  std::FILE *file;
+  uint64_t position = 0;
+
+  bool write(const void *data, size_t size) {
+    position += size;
+    return std::fwrite(data, 1, size, file) == size;
+  }
+
+  bool writeAt(uint64_t offset, const void *data, size_t size) {
+    static const uint8_t zeros[chunkAlignment] = {};
+
+    while (position < offset) {
+      size_t padding = static_cast<size_t>(
+          std::min<uint64_t>(offset - position, sizeof(zeros)));
+      if (!write(zeros, padding)) {
+        return false;
+      }
+    }
+    return position == offset && write(data, size);
+  }
+};
+
+bool sectionFits(const MappedFile &file, uint64_t offset, uint64_t size) {
+  return offset % sectionAlignment == 0 && offset <= file.size() &&
+         size <= file.size() - offset;
+}
+
+float enters(const Ray &ray, const glm::vec3 &invDir, const glm::vec3 &min,
+             const glm::vec3 &max, float maxT) {
+  glm::vec3 t0 = (min - ray.origin) * invDir;
+  glm::vec3 t1 = (max - ray.origin) * invDir;
+  glm::vec3 tNear = glm::min(t0, t1);
+  glm::vec3 tFar = glm::max(t0, t1);
+
+  float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+  float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, maxT));
+
+  return enter <= exit ? enter : std::numeric_limits<float>::infinity();
+}
+
+// Median splits of order[begin, end) along the widest axis of the centers,
+// appending each range of at most limit spheres to ranges.
+void splitChunks(const std::vector<Sphere> &spheres,
+                 std::vector<uint32_t> &order, uint32_t begin, uint32_t end,
+                 uint32_t limit,
+                 std::vector<std::pair<uint32_t, uint32_t>> &ranges) {
+  if (end - begin <= limit) {
+    ranges.emplace_back(begin, end);
+    return;
+  }
+
+  Aabb centers;
+  for (uint32_t i = begin; i < end; i++) {
+    centers.grow(spheres[order[i]].center);
+  }
+
+  glm::vec3 extent = centers.max - centers.min;
+  int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2)
+                                 : (extent.y > extent.z ? 1 : 2);
+
+  uint32_t mid = begin + (end - begin) / 2;
+  std::nth_element(order.begin() + begin, order.begin() + mid,
+                   order.begin() + end, [&](uint32_t a, uint32_t b) {
+                     return spheres[a].center[axis] < spheres[b].center[axis];
+                   });
+
+  splitChunks(spheres, order, begin, mid, limit, ranges);
+  splitChunks(spheres, order, mid, end, limit, ranges);
+}
+
+} // namespace
+
+bool saveChunkedScene(const std::string &path, const World &world,
+                      uint32_t chunkSpheres) {
+  const std::vector<Sphere> &spheres = world.spheres;
+  if (spheres.empty() || chunkSpheres == 0) {
+    fmt::println("Nothing to write to {}", path);
+    return false;
+  }
+
+  std::vector<uint32_t> order(spheres.size());
+  std::iota(order.begin(), order.end(), 0);
+
+  std::vector<std::pair<uint32_t, uint32_t>> ranges;
+  splitChunks(spheres, order, 0, static_cast<uint32_t>(order.size()),
+              chunkSpheres, ranges);
+
+  ChunkFileHeader header{};
+  std::memcpy(header.magic, chunkFileMagic, sizeof(header.magic));
+  header.version = chunkFileVersion;
+  header.chunkCount = static_cast<uint32_t>(ranges.size());
+  header.materialCount = static_cast<uint32_t>(world.materials.size());
+  header.lightCount = static_cast<uint32_t>(world.lights.size());
+  header.sphereCount = spheres.size();
+  header.cameraPosition = world.camera.position;
+  header.chunksOffset = alignUp(sizeof(ChunkFileHeader), sectionAlignment);
+  header.materialsOffset =
+      alignUp(header.chunksOffset + ranges.size() * sizeof(ChunkEntry),
+              sectionAlignment);
+  header.lightsOffset =
+      alignUp(header.materialsOffset + world.materials.size() * sizeof(Material),
+              sectionAlignment);
+
+  std::FILE *file = std::fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    fmt::println("Failed to open {} for writing", path);
+    return false;
+  }
+
+  // The entries depend on each chunk's BVH, so they are written last, over
+  // the zeros reserved for them here.
+  std::vector<ChunkEntry> entries(ranges.size());
+  FileWriter writer{file};
+  bool ok = writer.write(&header, sizeof(header)) &&
+            writer.writeAt(header.chunksOffset, entries.data(),
+                           entries.size() * sizeof(ChunkEntry)) &&
+            writer.writeAt(header.materialsOffset, world.materials.data(),
+                           world.materials.size() * sizeof(Material)) &&
+            writer.writeAt(header.lightsOffset, world.lights.data(),
+                           world.lights.size() * sizeof(Sphere));
+
+  // One chunk is built and written at a time.
+  Chunk chunk;
+  for (size_t c = 0; ok && c < ranges.size(); c++) {
+    auto [begin, end] = ranges[c];
+
+    chunk.spheres.clear();
+    Aabb bounds;
+    for (uint32_t i = begin; i < end; i++) {
+      const Sphere &sphere = spheres[order[i]];
+      chunk.spheres.push_back(sphere);
+      bounds.grow(sphere.center - glm::vec3{sphere.radius});
+      bounds.grow(sphere.center + glm::vec3{sphere.radius});
+    }
+    chunk.bvh.build(chunk.spheres);
+
+    ChunkEntry &entry = entries[c];
+    entry.min = bounds.min;
+    entry.max = bounds.max;
+    entry.sphereCount = end - begin;
+    entry.nodeCount = static_cast<uint32_t>(chunk.bvh.nodes.size());
+    entry.spheresOffset = alignUp(writer.position, chunkAlignment);
+    entry.nodesOffset = alignUp(
+        entry.spheresOffset + entry.sphereCount * sizeof(Sphere),
+        sectionAlignment);
+    entry.primitivesOffset = alignUp(
+        entry.nodesOffset + entry.nodeCount * sizeof(BvhNode),
+        sectionAlignment);
+
+    ok = writer.writeAt(entry.spheresOffset, chunk.spheres.data(),
+                        entry.sphereCount * sizeof(Sphere)) &&
+         writer.writeAt(entry.nodesOffset, chunk.bvh.nodes.data(),
+                        entry.nodeCount * sizeof(BvhNode)) &&
+         writer.writeAt(entry.primitivesOffset, chunk.bvh.primitives.data(),
+                        entry.sphereCount * sizeof(uint32_t));
+  }
+
+  ok = ok &&
+       std::fseek(file, static_cast<long>(header.chunksOffset), SEEK_SET) ==
+           0 &&
+       std::fwrite(entries.data(), sizeof(ChunkEntry), entries.size(), file) ==
+           entries.size();
+
+  ok = std::fclose(file) == 0 && ok;
+  if (!ok) {
+    fmt::println("Failed to write {}", path);
+  }
+  return ok;
+}
+
+bool ChunkedScene::open(const std::string &path, World &world) {
+  this->path = path;
+  entries.clear();
+  resident.clear();
+  lastUse.clear();
+  residentTotal = 0;
+
+  if (!file.open(path)) {
+    fmt::println("Failed to map {}", path);
+    return false;
+  }
+
+  ChunkFileHeader header;
+  if (file.size() < sizeof(header)) {
+    fmt::println("{} is not a chunked scene file", path);
+    return false;
+  }
+  std::memcpy(&header, file.data(), sizeof(header));
+
+  if (std::memcmp(header.magic, chunkFileMagic, sizeof(header.magic)) != 0) {
+    fmt::println("{} is not a chunked scene file", path);
+    return false;
+  }
+
+  if (header.version != chunkFileVersion) {
+    fmt::println("{} has version {}, expected {}", path, header.version,
+                 chunkFileVersion);
+    return false;
+  }
+
+  uint64_t chunksSize = uint64_t{header.chunkCount} * sizeof(ChunkEntry);
+  uint64_t materialsSize = uint64_t{header.materialCount} * sizeof(Material);
+  uint64_t lightsSize = uint64_t{header.lightCount} * sizeof(Sphere);
+  if (!sectionFits(file, header.chunksOffset, chunksSize) ||
+      !sectionFits(file, header.materialsOffset, materialsSize) ||
+      !sectionFits(file, header.lightsOffset, lightsSize)) {
+    fmt::println("{} is truncated or corrupt", path);
+    return false;
+  }
+
+  const ChunkEntry *chunks =
+      reinterpret_cast<const ChunkEntry *>(file.data() + header.chunksOffset);
+  entries.assign(chunks, chunks + header.chunkCount);
+
+  // Only the directory is checked up front; nothing here touches the
+  // chunks themselves.
+  uint64_t spheres = 0;
+  for (const ChunkEntry &entry : entries) {
+    bool valid =
+        entry.sphereCount > 0 && entry.nodeCount > 0 &&
+        sectionFits(file, entry.spheresOffset,
+                    uint64_t{entry.sphereCount} * sizeof(Sphere)) &&
+        sectionFits(file, entry.nodesOffset,
+                    uint64_t{entry.nodeCount} * sizeof(BvhNode)) &&
+        sectionFits(file, entry.primitivesOffset,
+                    uint64_t{entry.sphereCount} * sizeof(uint32_t));
+    if (!valid) {
+      fmt::println("{} is truncated or corrupt", path);
+      entries.clear();
+      return false;
+    }
+    spheres += entry.sphereCount;
+  }
+
+  if (spheres != header.sphereCount) {
+    fmt::println("{} is truncated or corrupt", path);
+    entries.clear();
+    return false;
+  }
+  totalSpheres = spheres;
+  materialCount = header.materialCount;
+
+  const Material *materials =
+      reinterpret_cast<const Material *>(file.data() + header.materialsOffset);
+  const Sphere *lights =
+      reinterpret_cast<const Sphere *>(file.data() + header.lightsOffset);
+
+  for (uint32_t i = 0; i < header.lightCount; i++) {
+    if (lights[i].material >= header.materialCount) {
+      fmt::println("{} has a light with an invalid material", path);
+      entries.clear();
+      return false;
+    }
+  }
+
+  world.camera.position = header.cameraPosition;
+  world.materials.assign(materials, materials + header.materialCount);
+  world.spheres.clear();
+  world.bvh = Bvh{};
+  world.lights.assign(lights, lights + header.lightCount);
+
+  std::vector<Sphere> bounds;
+  bounds.reserve(entries.size());
+  for (const ChunkEntry &entry : entries) {
+    bounds.push_back({(entry.min + entry.max) * 0.5f,
+                      glm::length(entry.max - entry.min) * 0.5f, 0});
+  }
+  chunkTree.build(bounds);
+
+  resident.resize(entries.size());
+  lastUse.assign(entries.size(), 0);
+  return true;
+}
+
+// Walks chunkTree like Bvh::hit() but collects every leaf instead of the
+// nearest; a leaf's chunks are then tested against their exact bounds,
+// which are tighter than the bounding spheres the tree was built over.
+void ChunkedScene::chunksAlong(const Ray &ray, float maxT,
+                               std::vector<ChunkCrossing> &crossings) const {
+  const std::vector<BvhNode> &nodes = chunkTree.nodes;
+  if (nodes.empty()) {
+    return;
+  }
+
+  glm::vec3 invDir = 1.0f / ray.direction;
+
+  uint32_t stack[maxDepth + 1];
+  uint32_t stackSize = 0;
+  stack[stackSize++] = 0;
+
+  while (stackSize > 0) {
+    const BvhNode &node = nodes[stack[--stackSize]];
+
+    if (enters(ray, invDir, node.min, node.max, maxT) ==
+        std::numeric_limits<float>::infinity()) {
+      continue;
+    }
+
+    if (node.count == 0) {
+      stack[stackSize++] = node.first;
+      stack[stackSize++] = node.first + 1;
+      continue;
+    }
+
+    for (uint32_t i = node.first; i < node.first + node.count; i++) {
+      uint32_t chunk = chunkTree.primitives[i];
+      const ChunkEntry &entry = entries[chunk];
+      float enter = enters(ray, invDir, entry.min, entry.max, maxT);
+      if (enter != std::numeric_limits<float>::infinity()) {
+        crossings.push_back({chunk, enter});
+      }
+    }
+  }
+}
+
+const Chunk &ChunkedScene::acquire(uint32_t chunk) {
+  lastUse[chunk] = ++useClock;
+
+  if (resident[chunk] == nullptr) {
+    const ChunkEntry &entry = entries[chunk];
+    size_t expected = entry.sphereCount * (sizeof(Sphere) + sizeof(uint32_t)) +
+                      entry.nodeCount * sizeof(BvhNode) +
+                      (entry.sphereCount + simdWidth - 1) *
+                          (4 * sizeof(float) + sizeof(uint32_t));
+    evictFor(expected);
+
+    auto loaded = std::make_unique<Chunk>();
+    pageIn(chunk, *loaded);
+    residentTotal += loaded->memoryBytes();
+    resident[chunk] = std::move(loaded);
+    pageInCount++;
+  }
+
+  return *resident[chunk];
+}
+
+// Drops least recently used chunks until bytes more fit in the budget or
+// nothing is left to drop.
+void ChunkedScene::evictFor(size_t bytes) {
+  while (residentTotal > 0 && residentTotal + bytes > budget) {
+    uint32_t oldest = 0;
+    uint64_t oldestUse = std::numeric_limits<uint64_t>::max();
+    for (uint32_t c = 0; c < resident.size(); c++) {
+      if (resident[c] != nullptr && lastUse[c] < oldestUse) {
+        oldest = c;
+        oldestUse = lastUse[c];
+      }
+    }
+
+    residentTotal -= resident[oldest]->memoryBytes();
+    resident[oldest].reset();
+    evictionCount++;
+  }
+}
+
+// A copy per section, like loadScene(). The copied pages of the mapping
+// are dropped right away; the chunk is read again from the file, or the
+// page cache, if it is ever paged back in.
+void ChunkedScene::pageIn(uint32_t chunk, Chunk &out) {
+  const ChunkEntry &entry = entries[chunk];
+  const uint8_t *data = file.data();
+
+  const Sphere *spheres =
+      reinterpret_cast<const Sphere *>(data + entry.spheresOffset);
+  const BvhNode *nodes =
+      reinterpret_cast<const BvhNode *>(data + entry.nodesOffset);
+  const uint32_t *primitives =
+      reinterpret_cast<const uint32_t *>(data + entry.primitivesOffset);
+
+  out.spheres.assign(spheres, spheres + entry.sphereCount);
+  out.bvh.nodes.assign(nodes, nodes + entry.nodeCount);
+  out.bvh.primitives.assign(primitives, primitives + entry.sphereCount);
+
+  file.discard(entry.spheresOffset, entry.primitivesOffset +
+                                        entry.sphereCount * sizeof(uint32_t) -
+                                        entry.spheresOffset);
+
+  // A corrupt chunk can't fail the render this late, so it is traced as
+  // empty, or with a rebuilt BVH when only the BVH is bad.
+  for (const Sphere &sphere : out.spheres) {
+    if (sphere.material >= materialCount) {
+      fmt::println("{} chunk {} has a sphere with an invalid material, "
+                   "skipping the chunk",
+                   path, chunk);
+      out.spheres.clear();
+      out.bvh.build(out.spheres);
+      return;
+    }
+  }
+
+  if (!out.bvh.valid(entry.sphereCount)) {
+    fmt::println("{} chunk {} has a corrupt BVH, rebuilding", path, chunk);
+    out.bvh.build(out.spheres);
+    return;
+  }
+
+  out.bvh.leaves.assign(out.spheres, out.bvh.primitives);
+}
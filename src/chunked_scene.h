@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bvh.h"
+#include "mapped_file.h"
+#include "world.h"
+
+// Out-of-core scene format (.ttc), for scenes too big to hold in memory.
+// Spheres are split into spatially compact chunks, each with its own BVH
+// over chunk-local indices, so one chunk can be paged in and traced
+// without the others:
+//
+//   ChunkFileHeader
+//   ChunkEntry chunks[chunkCount]
+//   Material   materials[materialCount]
+//   Sphere     lights[lightCount]      (the emissive spheres, again)
+//   then per chunk, starting on a chunkAlignment boundary:
+//     Sphere   spheres[sphereCount]
+//     BvhNode  nodes[nodeCount]
+//     uint32   primitives[sphereCount]
+//
+// Sections are 64-byte aligned as in .tts files. All values are
+// little-endian.
+constexpr char chunkFileMagic[8] = {'T', 'T', 'C', 'H', 'U', 'N', 'K', '\0'};
+constexpr uint32_t chunkFileVersion = 2;
+
+// Chunks start on their own pages, so paging one in or dropping it never
+// touches a neighbour.
+constexpr uint64_t chunkAlignment = 4096;
+
+constexpr uint32_t defaultChunkSpheres = 64 * 1024;
+
+struct ChunkFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t chunkCount;
+  uint32_t materialCount;
+  uint32_t lightCount;
+  uint64_t sphereCount;
+  glm::vec3 cameraPosition;
+  float padding;
+  uint64_t chunksOffset;
+  uint64_t materialsOffset;
+  uint64_t lightsOffset;
+  uint64_t padding2;
+};
+
+// bounds cover every sphere of the chunk, radius included.
+struct ChunkEntry {
+  glm::vec3 min;
+  uint32_t sphereCount;
+  glm::vec3 max;
+  uint32_t nodeCount;
+  uint64_t spheresOffset;
+  uint64_t nodesOffset;
+  uint64_t primitivesOffset;
+  uint64_t padding;
+};
+
+// Splits world's spheres at the median of the widest axis until every
+// chunk has at most chunkSpheres of them, and writes each chunk with its
+// own BVH. world.lights are stored apart from the chunks, since light
+// sampling needs all of them at every bounce, so they must be current. The
+// whole world has to fit in memory here; rendering from the file does not.
+bool saveChunkedScene(const std::string &path, const World &world,
+                      uint32_t chunkSpheres = defaultChunkSpheres);
+
+// A chunk in memory. Bvh indices are into spheres.
+struct Chunk {
+  std::vector<Sphere> spheres;
+  Bvh bvh;
+
+  size_t memoryBytes() const {
+    return spheres.capacity() * sizeof(Sphere) + bvh.memoryBytes();
+  }
+};
+
+// Where a ray enters a chunk's bounds.
+struct ChunkCrossing {
+  uint32_t chunk;
+  float enter;
+};
+
+// A .ttc file opened for rendering. The file is mapped whole but only
+// chunks rays actually reach are copied out of the mapping, and at most
+// budget bytes of them stay resident: paging one more in first drops the
+// least recently used chunks, along with their pages of the mapping. The
+// chunk being paged in is always kept, so a budget smaller than one chunk
+// still renders, one chunk at a time.
+//
+// acquire() is meant to be called from one thread; a chunk it returns
+// stays valid until the next call. chunksAlong() may run on any number of
+// threads at once.
+class ChunkedScene {
+public:
+  // Maps path and loads its camera, materials and lights into world.
+  // world's spheres and BVH are cleared; rays go through the chunks
+  // instead.
+  bool open(const std::string &path, World &world);
+
+  uint32_t chunkCount() const { return static_cast<uint32_t>(entries.size()); }
+  uint64_t sphereCount() const { return totalSpheres; }
+
+  // Appends every chunk whose bounds the ray enters before maxT.
+  void chunksAlong(const Ray &ray, float maxT,
+                   std::vector<ChunkCrossing> &crossings) const;
+
+  bool isResident(uint32_t chunk) const { return resident[chunk] != nullptr; }
+
+  // The chunk, paged in first if it isn't resident.
+  const Chunk &acquire(uint32_t chunk);
+
+  size_t budget = size_t{1} << 30;
+
+  size_t residentBytes() const { return residentTotal; }
+  uint64_t pageIns() const { return pageInCount; }
+  uint64_t evictions() const { return evictionCount; }
+
+private:
+  void pageIn(uint32_t chunk, Chunk &out);
+  void evictFor(size_t bytes);
+
+  std::string path;
+  MappedFile file;
+  std::vector<ChunkEntry> entries;
+  uint64_t totalSpheres = 0;
+  uint32_t materialCount = 0;
+
+  // Built over one bounding sphere per chunk, so chunksAlong() only tests
+  // the boxes of chunks near the ray.
+  Bvh chunkTree;
+
+  std::vector<std::unique_ptr<Chunk>> resident;
+  // Last acquire() of each chunk, for picking the least recently used.
+  std::vector<uint64_t> lastUse;
+  uint64_t useClock = 0;
+
+  size_t residentTotal = 0;
+  uint64_t pageInCount = 0;
+  uint64_t evictionCount = 0;
+};
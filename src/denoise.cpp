@@ -0,0 +1,132 @@
+#include "denoise.h"
+
+#include <cmath>
+#include <utility>
+
+namespace {
+
+constexpr uint32_t tileSize = 32;
+
+// B3-spline taps.
+constexpr float kernel[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4,
+                             1.0f / 16};
+
+// Edge-stopping strengths: luminance differences are measured in standard
+// deviations of the centre pixel, normals by a power of their cosine and
+// albedo by squared distance.
+constexpr float lumaSigma = 4.0f;
+constexpr float normalPower = 64.0f;
+constexpr float albedoSigma = 0.1f;
+
+float luma(const glm::vec3 &color) {
+  return glm::dot(color, glm::vec3{0.2126f, 0.7152f, 0.0722f});
+}
+
+} // namespace
+
+void Denoiser::resize(uint32_t newWidth, uint32_t newHeight) {
+  width = newWidth;
+  height = newHeight;
+  samples.resize(width * height);
+  guides.resize(width * height);
+  scratch.resize(width * height);
+}
+
+void Denoiser::run(TileScheduler &scheduler) {
+  for (uint32_t i = 0; i < iterations; i++) {
+    uint32_t step = 1u << i;
+    scheduler.run(width, height, tileSize,
+                  [&](const Tile &tile, uint32_t) { filter(tile, step); });
+    std::swap(samples, scratch);
+  }
+}
+
+// 3x3 Gaussian of the variance around (x, y). A single pixel's variance
+// estimate is too noisy at low sample counts to set its own edge threshold.
+float Denoiser::blurredVariance(uint32_t x, uint32_t y) const {
+  constexpr float taps[3] = {0.25f, 0.5f, 0.25f};
+
+  float sum = 0.0f;
+  float weightSum = 0.0f;
+  for (int dy = -1; dy <= 1; dy++) {
+    int qy = static_cast<int>(y) + dy;
+    if (qy < 0 || qy >= static_cast<int>(height)) {
+      continue;
+    }
+
+    for (int dx = -1; dx <= 1; dx++) {
+      int qx = static_cast<int>(x) + dx;
+      if (qx < 0 || qx >= static_cast<int>(width)) {
+        continue;
+      }
+
+      float weight = taps[dx + 1] * taps[dy + 1];
+      sum += weight * samples[static_cast<uint32_t>(qy) * width + qx].variance;
+      weightSum += weight;
+    }
+  }
+
+  return glm::max(sum / weightSum, 0.0f);
+}
+
+// One à-trous iteration from samples into scratch. The variance is filtered
+// with the squared weights, so later iterations, which see less noise, stop
+// at fainter edges.
+void Denoiser::filter(const Tile &tile, uint32_t step) {
+  for (uint32_t y = tile.y0; y < tile.y1; y++) {
+    for (uint32_t x = tile.x0; x < tile.x1; x++) {
+      uint32_t idx = y * width + x;
+      const DenoiseSample &center = samples[idx];
+      const DenoiseGuide &guide = guides[idx];
+
+      float centerLuma = luma(center.color);
+      float lumaScale =
+          1.0f / (lumaSigma * std::sqrt(blurredVariance(x, y)) + 1e-4f);
+
+      glm::vec3 color{0.0f};
+      float variance = 0.0f;
+      float weightSum = 0.0f;
+
+      for (int dy = -2; dy <= 2; dy++) {
+        int qy = static_cast<int>(y) + dy * static_cast<int>(step);
+        if (qy < 0 || qy >= static_cast<int>(height)) {
+          continue;
+        }
+
+        for (int dx = -2; dx <= 2; dx++) {
+          int qx = static_cast<int>(x) + dx * static_cast<int>(step);
+          if (qx < 0 || qx >= static_cast<int>(width)) {
+            continue;
+          }
+
+          uint32_t q = static_cast<uint32_t>(qy) * width + qx;
+          const DenoiseSample &sample = samples[q];
+          const DenoiseGuide &other = guides[q];
+
+          float cosine = glm::max(glm::dot(guide.normal, other.normal), 0.0f);
+          glm::vec3 albedoDelta = guide.albedo - other.albedo;
+
+          float weight =
+              kernel[dx + 2] * kernel[dy + 2] *
+              std::pow(cosine, normalPower) *
+              std::exp(-glm::dot(albedoDelta, albedoDelta) /
+                           (albedoSigma * albedoSigma) -
+                       std::abs(luma(sample.color) - centerLuma) * lumaScale);
+
+          color += weight * sample.color;
+          variance += weight * weight * sample.variance;
+          weightSum += weight;
+        }
+      }
+
+      // The centre tap always has a positive weight unless its normal is
+      // zero, as it is for pixels without samples.
+      if (weightSum <= 0.0f) {
+        scratch[idx] = center;
+        continue;
+      }
+
+      scratch[idx] = {color / weightSum, variance / (weightSum * weightSum)};
+    }
+  }
+}
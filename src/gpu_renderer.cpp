@@ -0,0 +1,365 @@
+#include "gpu_renderer.h"
+
+#ifdef TINYTRACER_GPU
+
+#include <cstring>
+#include <initializer_list>
+#include <fmt/core.h>
+#include <vector>
+
+namespace {
+
+// std430 mirrors of the structs in shaders/trace.comp.
+struct GpuSphere {
+  glm::vec4 centerRadius;
+  uint32_t material;
+  uint32_t padding[3];
+};
+
+struct GpuMaterial {
+  glm::vec4 albedoRoughness;
+  glm::vec4 metallicEmission;
+};
+
+struct GpuParams {
+  glm::vec4 origin;
+  glm::vec4 corner;
+  glm::vec4 deltaX;
+  glm::vec4 deltaY;
+  uint32_t frame[4];
+};
+
+static_assert(sizeof(BvhNode) == 32);
+static_assert(sizeof(GpuSphere) == 32);
+static_assert(sizeof(GpuMaterial) == 32);
+static_assert(sizeof(GpuParams) == 80);
+
+constexpr uint32_t groupSize = 8;
+
+SDL_GPUTexture *createTexture(SDL_GPUDevice *device, SDL_GPUTextureFormat format,
+                              SDL_GPUTextureUsageFlags usage, uint32_t width,
+                              uint32_t height) {
+  SDL_GPUTextureCreateInfo info{};
+  info.type = SDL_GPU_TEXTURETYPE_2D;
+  info.format = format;
+  info.usage = usage;
+  info.width = width;
+  info.height = height;
+  info.layer_count_or_depth = 1;
+  info.num_levels = 1;
+  return SDL_CreateGPUTexture(device, &info);
+}
+
+} // namespace
+
+GpuRenderer::~GpuRenderer() { close(); }
+
+bool GpuRenderer::open(const World &world, const RenderSettings &renderSettings,
+                       SDL_Window *targetWindow) {
+  close();
+  settings = renderSettings;
+
+  if (world.spheres.empty() || world.bvh.nodes.empty()) {
+    fmt::println("GPU rendering needs a non-empty, built world.");
+    return false;
+  }
+
+  device = SDL_CreateGPUDevice(SDL_GPU_SHADERFORMAT_SPIRV, false, nullptr);
+  if (device == nullptr) {
+    fmt::println("Failed to create a GPU device: {}", SDL_GetError());
+    return false;
+  }
+
+  if (targetWindow != nullptr) {
+    if (!SDL_ClaimWindowForGPUDevice(device, targetWindow)) {
+      fmt::println("Failed to claim the window: {}", SDL_GetError());
+      close();
+      return false;
+    }
+    window = targetWindow;
+  }
+
+  std::string path = std::string{TINYTRACER_SHADER_DIR} + "/trace.comp.spv";
+  size_t codeSize = 0;
+  void *code = SDL_LoadFile(path.c_str(), &codeSize);
+  if (code == nullptr) {
+    fmt::println("Failed to load {}: {}", path, SDL_GetError());
+    close();
+    return false;
+  }
+
+  SDL_GPUComputePipelineCreateInfo info{};
+  info.code_size = codeSize;
+  info.code = static_cast<const Uint8 *>(code);
+  info.entrypoint = "main";
+  info.format = SDL_GPU_SHADERFORMAT_SPIRV;
+  info.num_readonly_storage_buffers = 3;
+  info.num_readwrite_storage_textures = 2;
+  info.num_uniform_buffers = 1;
+  info.threadcount_x = groupSize;
+  info.threadcount_y = groupSize;
+  info.threadcount_z = 1;
+  pipeline = SDL_CreateGPUComputePipeline(device, &info);
+  SDL_free(code);
+
+  if (pipeline == nullptr) {
+    fmt::println("Failed to create the compute pipeline: {}", SDL_GetError());
+    close();
+    return false;
+  }
+
+  accumulation = createTexture(
+      device, SDL_GPU_TEXTUREFORMAT_R32G32B32A32_FLOAT,
+      SDL_GPU_TEXTUREUSAGE_COMPUTE_STORAGE_SIMULTANEOUS_READ_WRITE,
+      settings.width, settings.height);
+  display = createTexture(
+      device, SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM,
+      SDL_GPU_TEXTUREUSAGE_COMPUTE_STORAGE_WRITE | SDL_GPU_TEXTUREUSAGE_SAMPLER,
+      settings.width, settings.height);
+
+  if (accumulation == nullptr || display == nullptr) {
+    fmt::println("Failed to create GPU textures: {}", SDL_GetError());
+    close();
+    return false;
+  }
+
+  if (!upload(world)) {
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+void GpuRenderer::close() {
+  if (device == nullptr) {
+    return;
+  }
+
+  SDL_WaitForGPUIdle(device);
+
+  for (SDL_GPUBuffer **buffer : {&nodes, &spheres, &materials}) {
+    if (*buffer != nullptr) {
+      SDL_ReleaseGPUBuffer(device, *buffer);
+      *buffer = nullptr;
+    }
+  }
+
+  for (SDL_GPUTexture **texture : {&accumulation, &display}) {
+    if (*texture != nullptr) {
+      SDL_ReleaseGPUTexture(device, *texture);
+      *texture = nullptr;
+    }
+  }
+
+  if (pipeline != nullptr) {
+    SDL_ReleaseGPUComputePipeline(device, pipeline);
+    pipeline = nullptr;
+  }
+
+  if (window != nullptr) {
+    SDL_ReleaseWindowFromGPUDevice(device, window);
+    window = nullptr;
+  }
+
+  SDL_DestroyGPUDevice(device);
+  device = nullptr;
+  passCount = 0;
+}
+
+bool GpuRenderer::upload(const World &world) {
+  std::vector<GpuSphere> leafSpheres(world.bvh.primitives.size());
+  for (size_t i = 0; i < leafSpheres.size(); i++) {
+    const Sphere &sphere = world.spheres[world.bvh.primitives[i]];
+    leafSpheres[i] = {glm::vec4{sphere.center, sphere.radius},
+                      sphere.material,
+                      {}};
+  }
+
+  std::vector<GpuMaterial> gpuMaterials(world.materials.size());
+  for (size_t i = 0; i < gpuMaterials.size(); i++) {
+    const Material &mat = world.materials[i];
+    gpuMaterials[i] = {glm::vec4{mat.albedo, mat.roughness},
+                       glm::vec4{mat.metallic, mat.emission}};
+  }
+
+  SDL_WaitForGPUIdle(device);
+  for (SDL_GPUBuffer **buffer : {&nodes, &spheres, &materials}) {
+    if (*buffer != nullptr) {
+      SDL_ReleaseGPUBuffer(device, *buffer);
+      *buffer = nullptr;
+    }
+  }
+
+  bool uploaded =
+      createBuffer(nodes, world.bvh.nodes.data(),
+                   static_cast<uint32_t>(world.bvh.nodes.size() *
+                                         sizeof(BvhNode))) &&
+      createBuffer(spheres, leafSpheres.data(),
+                   static_cast<uint32_t>(leafSpheres.size() *
+                                         sizeof(GpuSphere))) &&
+      createBuffer(materials, gpuMaterials.data(),
+                   static_cast<uint32_t>(gpuMaterials.size() *
+                                         sizeof(GpuMaterial)));
+
+  reset();
+  return uploaded;
+}
+
+bool GpuRenderer::createBuffer(SDL_GPUBuffer *&buffer, const void *data,
+                               uint32_t size) {
+  SDL_GPUBufferCreateInfo bufferInfo{};
+  bufferInfo.usage = SDL_GPU_BUFFERUSAGE_COMPUTE_STORAGE_READ;
+  bufferInfo.size = size;
+  buffer = SDL_CreateGPUBuffer(device, &bufferInfo);
+
+  SDL_GPUTransferBufferCreateInfo transferInfo{};
+  transferInfo.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD;
+  transferInfo.size = size;
+  SDL_GPUTransferBuffer *transfer =
+      SDL_CreateGPUTransferBuffer(device, &transferInfo);
+
+  if (buffer == nullptr || transfer == nullptr) {
+    fmt::println("Failed to create GPU buffers: {}", SDL_GetError());
+    if (transfer != nullptr) {
+      SDL_ReleaseGPUTransferBuffer(device, transfer);
+    }
+    return false;
+  }
+
+  void *mapped = SDL_MapGPUTransferBuffer(device, transfer, false);
+  std::memcpy(mapped, data, size);
+  SDL_UnmapGPUTransferBuffer(device, transfer);
+
+  SDL_GPUCommandBuffer *commands = SDL_AcquireGPUCommandBuffer(device);
+  SDL_GPUCopyPass *copy = SDL_BeginGPUCopyPass(commands);
+
+  SDL_GPUTransferBufferLocation source{};
+  source.transfer_buffer = transfer;
+  SDL_GPUBufferRegion destination{};
+  destination.buffer = buffer;
+  destination.size = size;
+  SDL_UploadToGPUBuffer(copy, &source, &destination, false);
+
+  SDL_EndGPUCopyPass(copy);
+  SDL_SubmitGPUCommandBuffer(commands);
+
+  // Released buffers are kept alive by SDL until the upload completes.
+  SDL_ReleaseGPUTransferBuffer(device, transfer);
+  return true;
+}
+
+void GpuRenderer::renderPass(const Camera &camera) {
+  CameraRays rays = cameraRays(settings.width, settings.height, settings.fov);
+
+  GpuParams params{glm::vec4{camera.position, 0.0f},
+                   glm::vec4{rays.corner, 0.0f},
+                   glm::vec4{rays.deltaX, 0.0f},
+                   glm::vec4{rays.deltaY, 0.0f},
+                   {settings.width, settings.height, passCount,
+                    static_cast<uint32_t>(settings.rayDepth)}};
+
+  SDL_GPUCommandBuffer *commands = SDL_AcquireGPUCommandBuffer(device);
+  if (commands == nullptr) {
+    fmt::println("Failed to acquire a GPU command buffer: {}", SDL_GetError());
+    return;
+  }
+
+  SDL_PushGPUComputeUniformData(commands, 0, &params, sizeof(params));
+
+  SDL_GPUStorageTextureReadWriteBinding targets[2] = {};
+  targets[0].texture = accumulation;
+  targets[1].texture = display;
+
+  SDL_GPUComputePass *pass =
+      SDL_BeginGPUComputePass(commands, targets, 2, nullptr, 0);
+  SDL_BindGPUComputePipeline(pass, pipeline);
+
+  SDL_GPUBuffer *buffers[3] = {nodes, spheres, materials};
+  SDL_BindGPUComputeStorageBuffers(pass, 0, buffers, 3);
+
+  SDL_DispatchGPUCompute(pass, (settings.width + groupSize - 1) / groupSize,
+                         (settings.height + groupSize - 1) / groupSize, 1);
+  SDL_EndGPUComputePass(pass);
+  SDL_SubmitGPUCommandBuffer(commands);
+
+  passCount++;
+}
+
+void GpuRenderer::present() {
+  if (window == nullptr) {
+    return;
+  }
+
+  SDL_GPUCommandBuffer *commands = SDL_AcquireGPUCommandBuffer(device);
+  if (commands == nullptr) {
+    return;
+  }
+
+  SDL_GPUTexture *swapchain = nullptr;
+  Uint32 swapchainWidth, swapchainHeight;
+  if (SDL_WaitAndAcquireGPUSwapchainTexture(commands, window, &swapchain,
+                                            &swapchainWidth,
+                                            &swapchainHeight) &&
+      swapchain != nullptr) {
+    SDL_GPUBlitInfo blit{};
+    blit.source.texture = display;
+    blit.source.w = settings.width;
+    blit.source.h = settings.height;
+    blit.destination.texture = swapchain;
+    blit.destination.w = swapchainWidth;
+    blit.destination.h = swapchainHeight;
+    blit.load_op = SDL_GPU_LOADOP_DONT_CARE;
+    blit.filter = SDL_GPU_FILTER_LINEAR;
+    SDL_BlitGPUTexture(commands, &blit);
+  }
+
+  SDL_SubmitGPUCommandBuffer(commands);
+}
+
+bool GpuRenderer::resolveLinear(float *rgb) {
+  uint32_t pixelCount = settings.width * settings.height;
+  uint32_t size = pixelCount * 4 * sizeof(float);
+
+  SDL_GPUTransferBufferCreateInfo transferInfo{};
+  transferInfo.usage = SDL_GPU_TRANSFERBUFFERUSAGE_DOWNLOAD;
+  transferInfo.size = size;
+  SDL_GPUTransferBuffer *transfer =
+      SDL_CreateGPUTransferBuffer(device, &transferInfo);
+  if (transfer == nullptr) {
+    fmt::println("Failed to create a GPU transfer buffer: {}", SDL_GetError());
+    return false;
+  }
+
+  SDL_GPUCommandBuffer *commands = SDL_AcquireGPUCommandBuffer(device);
+  SDL_GPUCopyPass *copy = SDL_BeginGPUCopyPass(commands);
+
+  SDL_GPUTextureRegion source{};
+  source.texture = accumulation;
+  source.w = settings.width;
+  source.h = settings.height;
+  source.d = 1;
+  SDL_GPUTextureTransferInfo destination{};
+  destination.transfer_buffer = transfer;
+  SDL_DownloadFromGPUTexture(copy, &source, &destination);
+
+  SDL_EndGPUCopyPass(copy);
+  SDL_GPUFence *fence = SDL_SubmitGPUCommandBufferAndAcquireFence(commands);
+  SDL_WaitForGPUFences(device, true, &fence, 1);
+  SDL_ReleaseGPUFence(device, fence);
+
+  const float *sums =
+      static_cast<const float *>(SDL_MapGPUTransferBuffer(device, transfer, false));
+  for (uint32_t i = 0; i < pixelCount; i++) {
+    float scale = sums[i * 4 + 3] > 0.0f ? 1.0f / sums[i * 4 + 3] : 0.0f;
+    rgb[i * 3 + 0] = sums[i * 4 + 0] * scale;
+    rgb[i * 3 + 1] = sums[i * 4 + 1] * scale;
+    rgb[i * 3 + 2] = sums[i * 4 + 2] * scale;
+  }
+  SDL_UnmapGPUTransferBuffer(device, transfer);
+  SDL_ReleaseGPUTransferBuffer(device, transfer);
+
+  return true;
+}
+
+#endif
@@ -0,0 +1,72 @@
+#pragma once
+
+#ifdef TINYTRACER_GPU
+
+#include <SDL3/SDL.h>
+#include <cstdint>
+#include <string>
+
+#include "renderer.h"
+#include "world.h"
+
+// Progressive renderer on the GPU through SDL_GPU compute. The world's BVH
+// nodes are uploaded as they are; spheres go up in leaf order, padded to
+// 32 bytes, with their materials. Each renderPass() dispatches
+// shaders/trace.comp once, adding one sample per pixel to a float
+// accumulation texture and writing the tone-mapped estimate to a display
+// texture that present() blits to the window. There is no adaptive
+// sampling; every pixel gets settings.sampleCount samples.
+//
+// Only SPIR-V is built, so this needs SDL_GPU's Vulkan backend.
+class GpuRenderer {
+public:
+  GpuRenderer() = default;
+  ~GpuRenderer();
+
+  GpuRenderer(const GpuRenderer &) = delete;
+  GpuRenderer &operator=(const GpuRenderer &) = delete;
+
+  // Creates the device, pipeline and textures and uploads world. window
+  // may be null for offscreen use, in which case present() does nothing.
+  // World must already be built.
+  bool open(const World &world, const RenderSettings &settings,
+            SDL_Window *window);
+  void close();
+
+  // Re-uploads spheres, materials and BVH, e.g. after an edit, and resets.
+  bool upload(const World &world);
+
+  // Throws away every sample so far; the next pass overwrites them.
+  void reset() { passCount = 0; }
+
+  void renderPass(const Camera &camera);
+  bool done() const { return passCount >= settings.sampleCount; }
+  uint32_t passes() const { return passCount; }
+
+  // Blits the display texture to the window and presents it.
+  void present();
+
+  // Waits for the GPU and reads the averaged linear radiance back as packed
+  // RGB floats, in the same layout as Renderer::resolveLinear().
+  bool resolveLinear(float *rgb);
+
+  RenderSettings settings;
+
+private:
+  bool createBuffer(SDL_GPUBuffer *&buffer, const void *data, uint32_t size);
+
+  SDL_GPUDevice *device = nullptr;
+  SDL_Window *window = nullptr;
+  SDL_GPUComputePipeline *pipeline = nullptr;
+
+  SDL_GPUBuffer *nodes = nullptr;
+  SDL_GPUBuffer *spheres = nullptr;
+  SDL_GPUBuffer *materials = nullptr;
+
+  SDL_GPUTexture *accumulation = nullptr;
+  SDL_GPUTexture *display = nullptr;
+
+  uint32_t passCount = 0;
+};
+
+#endif
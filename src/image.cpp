@@ -0,0 +1,47 @@
+#include "image.h"
+
+#include <fmt/core.h>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+namespace {
+
+bool endsWith(const std::string &s, const std::string &suffix) {
+  return s.size() >= suffix.size() &&
+         s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+} // namespace
+
+bool writeImage(const std::string &path, Renderer &renderer) {
+  int w = static_cast<int>(renderer.settings.width);
+  int h = static_cast<int>(renderer.settings.height);
+  size_t count = static_cast<size_t>(w) * h;
+
+  if (endsWith(path, ".hdr")) {
+    std::vector<float> rgb(count * 3);
+    renderer.resolveLinear(rgb.data());
+    return stbi_write_hdr(path.c_str(), w, h, 3, rgb.data()) != 0;
+  }
+
+  if (endsWith(path, ".png")) {
+    std::vector<uint32_t> pixels(count);
+    renderer.resolve(pixels.data());
+
+    std::vector<uint8_t> rgb(count * 3);
+    for (size_t i = 0; i < count; i++) {
+      rgb[i * 3 + 0] = static_cast<uint8_t>(pixels[i] >> 24);
+      rgb[i * 3 + 1] = static_cast<uint8_t>(pixels[i] >> 16);
+      rgb[i * 3 + 2] = static_cast<uint8_t>(pixels[i] >> 8);
+    }
+    return stbi_write_png(path.c_str(), w, h, 3, rgb.data(), w * 3) != 0;
+  }
+
+  fmt::println("Unsupported image format: {}", path);
+  return false;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "renderer.h"
+
+// Writes the renderer's current estimate to path. The format follows the
+// extension: .png is tone-mapped 8-bit, .hdr keeps linear radiance.
+bool writeImage(const std::string &path, Renderer &renderer);
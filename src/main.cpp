@@ -1,18 +1,30 @@
 #include <SDL3/SDL.h>
+#include <algorithm>
+#include <charconv>
+#include <condition_variable>
 #include <cstdint>
-#include <cstring>
+#include <cstdlib>
 #include <fmt/core.h>
 #include <glm/common.hpp>
 #include <glm/glm.hpp>
-#include <limits>
-#include <random>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
 #include <vector>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
-
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
+#include "checkpoint.h"
+#include "chunked_scene.h"
+#include "gpu_renderer.h"
+#include "image.h"
+#include "partial_file.h"
+#include "profile.h"
+#include "renderer.h"
+#include "scene_file.h"
+#include "scenes.h"
+#include "world.h"
 
 #ifdef _MSC_VER
 #define DEBUG_BREAK() __debugbreak()
@@ -27,160 +39,138 @@
     DEBUG_BREAK();                                                             \
   }
 
-float randomFloat();
-float randomFloat(float min, float max);
+// Milliseconds between display refreshes while passes are running.
+uint64_t refreshInterval = 100;
 
-glm::vec3 randomVec3();
-glm::vec3 randomVec3(float min, float max);
+// While the window is being resized frames render at 1/resizeScale of its
+// size; resizeSettle milliseconds after the last resize event a
+// full-resolution render starts.
+uint32_t resizeScale = 4;
+uint64_t resizeSettle = 150;
 
-glm::vec2 randomVec2(float min, float max);
-glm::vec2 randomVec2();
+uint32_t w, h;
 
-glm::vec3 randomUnitVec3OnSphere();
+struct Options {
+  bool headless = false;
+  bool wavefront = false;
+  // Denoise every resolved frame; pairs with a low --spp.
+  bool denoise = false;
+  SamplerKind sampler = RenderSettings{}.sampler;
+  // Applied to PNG output and the window; HDR output stays linear.
+  ToneMapSettings toneMap{};
+  // Render on the GPU through SDL_GPU compute; needs a TINYTRACER_GPU build.
+  bool gpu = false;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t sampleCount = RenderSettings{}.sampleCount;
+  uint32_t minSamples = RenderSettings{}.minSamples;
+  float adaptiveThreshold = RenderSettings{}.adaptiveThreshold;
+  uint32_t threadCount = 0;
+  std::string output = "render.png";
+  // Load the world from a .tts file instead of the built-in scene.
+  std::string scene;
+  // Replace the built-in scene with generateScene(layout, randomSpheres, 1).
+  uint32_t randomSpheres = 0;
+  SceneLayout layout = SceneLayout::Random;
+  // Write the world, BVH included, to a .tts file and exit.
+  std::string writeScene;
+  // Write the world as a .ttc of chunks with up to chunkSpheres spheres
+  // each and exit.
+  std::string writeChunked;
+  uint32_t chunkSpheres = defaultChunkSpheres;
+  // Headless only: render out of core from a .ttc file, keeping at most
+  // memoryBudget MiB of chunks in memory.
+  std::string chunked;
+  uint32_t memoryBudget = 1024;
+  // Print the profile and write a Chrome trace here on exit. Needs a
+  // TINYTRACER_PROFILE build.
+  std::string trace;
+  // Distributed rendering. A worker renders headless into a .ttp partial
+  // instead of an image, optionally limited to region and starting at
+  // firstSample; a coordinator merges every --merge file into output.
+  std::string partial;
+  uint32_t firstSample = 0;
+  Tile region{};
+  std::vector<std::string> merge;
+  // Headless only: resume from this .ttp if it exists and rewrite it every
+  // checkpointInterval seconds and at the end.
+  std::string checkpoint;
+  uint32_t checkpointInterval = 60;
+};
 
-glm::vec2 pixelToWorld(float pixelX, float pixelY);
+// Distance the camera or the selected sphere moves per key press.
+constexpr float editStep = 0.05f;
 
-bool nearZero(const glm::vec3& vec);
+// Stops of exposure per key press.
+constexpr float exposureStep = 0.5f;
 
-struct Material {
-  glm::vec3 albedo;
-  float roughness;
-  float metallic;
-};
+// A resolved image waiting to be shown.
+struct Frame {
+  std::vector<uint32_t> pixels;
+  uint32_t width = 0;
+  uint32_t height = 0;
 
-struct Sphere {
-  glm::vec3 center;
-  float radius;
-  Material material;
-};
-
-struct Camera {
-  glm::vec3 position;
+  void resize(uint32_t newWidth, uint32_t newHeight) {
+    pixels.resize(newWidth * newHeight);
+    width = newWidth;
+    height = newHeight;
+  }
 };
 
-struct HitRecord {
-  Sphere *sphere;
-  float t;
+// One interactive change to the world, queued by the event loop and applied
+// by the render thread between passes.
+struct SceneEdit {
+  glm::vec3 cameraOffset{0.0f};
+  uint32_t sphere = 0;
+  glm::vec3 sphereOffset{0.0f};
+  bool toggleMetallic = false;
 };
 
-struct Ray {
-  glm::vec3 origin;
-  glm::vec3 direction;
-
-  glm::vec3 at(float t) const { return origin + t * direction; }
-
-  Ray scatter(const glm::vec3& p, const glm::vec3& n, const Material& mat) const {
-    if (mat.metallic) {
-      return Ray{p, glm::reflect(p - origin, n)};
-    }
-
-    glm::vec3 dir = randomUnitVec3OnSphere();
-
-    if (nearZero(n + dir)) {
-      dir = n;
-    }
-
-    return Ray{p, n + dir};
+bool parseOptions(int argc, char **argv, Options &options);
+bool setupWorld(const Options &options);
+int renderHeadless(const Options &options);
+int mergePartials(const Options &options);
+bool writeProfile(const Options &options);
+int renderGpu(const Options &options);
+bool editFromKey(SDL_Scancode key, uint32_t &selected, SceneEdit &edit);
+bool toneMapFromKey(SDL_Scancode key, ToneMapSettings &toneMap);
+void applyEdit(const SceneEdit &edit);
+
+World world = defaultScene();
+ChunkedScene chunkedScene;
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    return 1;
   }
 
-  float intersects(const Sphere &sphere, float minT, float maxT) const {
-    glm::vec3 oc = sphere.center - origin;
-    float a = glm::dot(direction, direction);
-    float h = glm::dot(direction, oc);
-    float c = glm::dot(oc, oc) - (sphere.radius * sphere.radius);
-    float d = h * h - a * c;
-
-    if (d < 0) {
-      return -1.0f;
-    }
-
-    d = glm::sqrt(d);
-
-    float t = (h - d) / a;
-
-    if (t <= minT || t >= maxT) {
-      t = (h + d) / a;
-      if (t <= minT || t >= maxT) {
-        return -1.0f;
-      }
-    }
-
-    return t;
+  if (!options.merge.empty()) {
+    return mergePartials(options);
   }
-};
-
-struct World {
-  Camera camera;
-  std::vector<Sphere> spheres;
-
-  glm::vec3 color(const Ray &ray, float depth) {
-    if (depth <= 0) {
-      return glm::vec3{0.0};
-    }
-
-    HitRecord record = hit(ray);
-    Sphere *sphere = record.sphere;
-
-    if (sphere == nullptr) {
-      return glm::vec3{0.5, 0.8, 0.9};
-    }
-
-    glm::vec3 p = ray.at(record.t);
-    glm::vec3 n = (p - sphere->center) / sphere->radius;
 
-    Material &mat = sphere->material;
-    Ray scattered = ray.scatter(p, n, mat);
-
-    return 0.25f * mat.albedo * color(scattered, depth - 1);
+  if (!setupWorld(options)) {
+    return 1;
   }
 
-  HitRecord hit(const Ray &ray) {
-    float closestT = std::numeric_limits<float>::max();
-    Sphere *closestSphere = nullptr;
-
-    for (Sphere &sphere : spheres) {
-      float t =
-          ray.intersects(sphere, 0.001, std::numeric_limits<float>::infinity());
-
-      if (t < 0 || t > closestT) {
-        continue;
-      }
+  if (!options.writeScene.empty()) {
+    return saveScene(options.writeScene, world) ? 0 : 1;
+  }
 
-      closestT = t;
-      closestSphere = &sphere;
-    }
+  if (!options.writeChunked.empty()) {
+    return saveChunkedScene(options.writeChunked, world, options.chunkSpheres)
+               ? 0
+               : 1;
+  }
 
-    return {closestSphere, closestT};
-  };
-};
+  if (options.headless) {
+    return renderHeadless(options);
+  }
 
-float fov = glm::tan(glm::radians(60.0f / 2.0f));
-float sampleCount = 150.0f;
-float rayDepth = 50.0f;
+  if (options.gpu) {
+    return renderGpu(options);
+  }
 
-uint32_t w, h;
-float aspectRatio;
-
-World world{.camera = {.position = glm::vec3{0.0f}},
-            .spheres = {
-                {.center = glm::vec3{0.0f, 0.0f, -1.0},
-                 .radius = 0.2f,
-                 .material = {.albedo = glm::vec3{0.5, 0.5, 0.5},
-                              .roughness = 1.0f,
-                              .metallic = 0.0f}},
-                {.center = glm::vec3{0.45f, 0.0f, -1.0},
-                 .radius = 0.2f,
-                 .material = {.albedo = glm::vec3{1.0, 1.0, 1.0},
-                              .roughness = 1.0f,
-                              .metallic = 1.0f}},
-                {.center = glm::vec3{0.0f, -100.21f, -1.0},
-                 .radius = 100.0f,
-                 .material = {.albedo = glm::vec3{0.4, 0.8, 0.5},
-                              .roughness = 1.0f,
-                              .metallic = 0.0f}},
-            }};
-
-int main() {
   bool isRunning = true;
 
   SDL_ASSERT(SDL_Init(SDL_INIT_VIDEO));
@@ -192,10 +182,8 @@ int main() {
   const SDL_DisplayMode *displayMode = SDL_GetCurrentDisplayMode(displays[0]);
   SDL_ASSERT(displayMode != nullptr);
 
-  w = displayMode->w / 3;
-  h = displayMode->h / 3;
-
-  aspectRatio = static_cast<float>(w) / h;
+  w = options.width ? options.width : displayMode->w / 3;
+  h = options.height ? options.height : displayMode->h / 3;
 
   SDL_Window *window =
       SDL_CreateWindow("tinytracer", static_cast<int>(w), static_cast<int>(h),
@@ -205,6 +193,9 @@ int main() {
   SDL_Renderer *renderer = SDL_CreateRenderer(window, nullptr);
   SDL_ASSERT(renderer != nullptr);
 
+  // Presents never outpace the display; failing is fine, frames are rare.
+  SDL_SetRenderVSync(renderer, 1);
+
   SDL_Texture *texture = SDL_CreateTexture(
       renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
       static_cast<int>(w), static_cast<int>(h));
@@ -213,111 +204,814 @@ int main() {
   SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_NONE);
   SDL_SetTextureAlphaMod(texture, 255);
 
-  std::vector<uint32_t> pixels(w * h);
+  // The texture only grows; smaller frames use its top-left corner.
+  uint32_t textureWidth = w;
+  uint32_t textureHeight = h;
+
+  // Triple-buffered frames: the render thread resolves into frames[drawing]
+  // and the main thread uploads frames[showing], so neither waits on the
+  // other. Only swapping in frames[ready] takes framesMutex.
+  Frame frames[3];
+  for (Frame &frame : frames) {
+    frame.resize(w, h);
+  }
+  uint32_t drawing = 0;
+  uint32_t ready = 1;
+  uint32_t showing = 2;
+  bool frameReady = false;
+
+  Renderer tracer{world,
+                  {.width = w,
+                   .height = h,
+                   .sampleCount = options.sampleCount,
+                   .minSamples = options.minSamples,
+                   .adaptiveThreshold = options.adaptiveThreshold,
+                   .wavefront = options.wavefront,
+                   .threadCount = options.threadCount,
+                   .denoise = options.denoise,
+                   .sampler = options.sampler,
+                   .toneMap = options.toneMap}};
+
+  // Passes run on their own thread so the event loop stays live; every
+  // refreshInterval the latest estimate is resolved into a frame. Edits
+  // cancel the pass in flight and restart accumulation, and the first pass
+  // after a restart is shown right away. Resizes are handed over the same
+  // way as edits, with 0 meaning no resize pending.
+  std::mutex framesMutex;
+
+  // Pushed by the render thread after every new frame, waking the event
+  // loop so it only uploads and presents when there is something new.
+  uint32_t frameEvent = SDL_RegisterEvents(1);
+  SDL_ASSERT(frameEvent != 0);
+
+  std::mutex editsMutex;
+  std::condition_variable editsReady;
+  std::vector<SceneEdit> pendingEdits;
+  uint32_t pendingWidth = 0;
+  uint32_t pendingHeight = 0;
+  // Tone-map changes only need the current samples resolved again.
+  ToneMapSettings toneMap = options.toneMap;
+  bool toneMapChanged = false;
+  bool quitting = false;
+
+  std::thread renderThread{[&] {
+    uint64_t lastRefresh = SDL_GetTicks();
+    bool restarted = false;
+
+    while (true) {
+      std::vector<SceneEdit> edits;
+      uint32_t width, height;
+      {
+        std::unique_lock lock{editsMutex};
+        editsReady.wait(lock, [&] {
+          return quitting || !pendingEdits.empty() || pendingWidth != 0 ||
+                 toneMapChanged || !tracer.done();
+        });
+        if (quitting) {
+          return;
+        }
+        edits.swap(pendingEdits);
+        width = std::exchange(pendingWidth, 0);
+        height = std::exchange(pendingHeight, 0);
+        if (std::exchange(toneMapChanged, false)) {
+          tracer.settings.toneMap = toneMap;
+          restarted = true;
+        }
+      }
+
+      if (!edits.empty()) {
+        for (const SceneEdit &edit : edits) {
+          applyEdit(edit);
+        }
+        tracer.reset();
+        restarted = true;
+      }
 
-  for (uint32_t y = 0; y < h; y++) {
-    for (uint32_t x = 0; x < w; x++) {
-      glm::vec3 pixelColor{0.0};
-      uint32_t idx = y * w + x;
+      if (width != 0) {
+        tracer.resize(width, height);
+        restarted = true;
+      }
 
-      Ray ray{};
-      ray.origin = world.camera.position;
+      if (!tracer.done()) {
+        tracer.renderPass();
+        if (tracer.isCancelled()) {
+          continue;
+        }
+      }
 
-      for (uint32_t i = 0; i < sampleCount; i++) {
-        glm::vec2 offset = randomVec2(-0.5f, 0.5f);
-        glm::vec2 pos = pixelToWorld(static_cast<float>(x) + offset.x,
-                                     static_cast<float>(y) + offset.y);
-        ray.direction = glm::normalize(glm::vec3{pos, -1.0f} - ray.origin);
-        pixelColor += world.color(ray, rayDepth);
+      uint64_t now = SDL_GetTicks();
+      if (restarted || now - lastRefresh >= refreshInterval || tracer.done()) {
+        // Frames rotate through all three slots, so whichever one comes
+        // round may still have the size of an earlier render.
+        Frame &frame = frames[drawing];
+        if (frame.width != tracer.settings.width ||
+            frame.height != tracer.settings.height) {
+          frame.resize(tracer.settings.width, tracer.settings.height);
+        }
+        tracer.resolve(frame.pixels.data());
+        lastRefresh = now;
+        restarted = false;
+
+        {
+          std::lock_guard lock{framesMutex};
+          std::swap(drawing, ready);
+          frameReady = true;
+        }
+
+        SDL_Event event{};
+        event.type = frameEvent;
+        SDL_PushEvent(&event);
       }
+    }
+  }};
+
+  uint32_t selected = 0;
+  uint64_t lastResize = 0;
+  bool resizing = false;
+
+  auto requestResize = [&](uint32_t width, uint32_t height) {
+    std::lock_guard lock{editsMutex};
+    pendingWidth = std::max(width, 1u);
+    pendingHeight = std::max(height, 1u);
+    tracer.cancel();
+    editsReady.notify_one();
+  };
 
-      pixelColor = glm::clamp(glm::sqrt(pixelColor / sampleCount), 0.0f, 1.0f);
+  // Set whenever the window contents need drawing again without a new
+  // frame, e.g. after an expose.
+  bool redraw = true;
 
-      pixels[idx] = static_cast<uint32_t>(pixelColor.r * 255) << 24 |
-                    static_cast<uint32_t>(pixelColor.g * 255) << 16 |
-                    static_cast<uint32_t>(pixelColor.b * 255) << 8 | 0x000000FF;
+  auto handleEvent = [&](const SDL_Event &event) {
+    if (event.type == SDL_EVENT_WINDOW_CLOSE_REQUESTED) {
+      isRunning = false;
+    }
+    if (event.type == SDL_EVENT_KEY_DOWN &&
+        event.key.scancode == SDL_SCANCODE_ESCAPE) {
+      isRunning = false;
     }
-  }
 
-  void *texturePixels;
-  int pitch;
-  SDL_LockTexture(texture, nullptr, &texturePixels, &pitch);
-  memcpy(texturePixels, pixels.data(), pixels.size() * sizeof(uint32_t));
-  SDL_UnlockTexture(texture);
+    SceneEdit edit;
+    if (event.type == SDL_EVENT_KEY_DOWN &&
+        editFromKey(event.key.scancode, selected, edit)) {
+      // Cancelling under the lock keeps it ordered before the reset()
+      // that consumes this edit, so it can't abort the restarted pass.
+      std::lock_guard lock{editsMutex};
+      pendingEdits.push_back(edit);
+      tracer.cancel();
+      editsReady.notify_one();
+    }
 
+    if (event.type == SDL_EVENT_KEY_DOWN) {
+      std::lock_guard lock{editsMutex};
+      if (toneMapFromKey(event.key.scancode, toneMap)) {
+        toneMapChanged = true;
+        editsReady.notify_one();
+      }
+    }
+
+    if (event.type == SDL_EVENT_WINDOW_RESIZED) {
+      w = static_cast<uint32_t>(event.window.data1);
+      h = static_cast<uint32_t>(event.window.data2);
+      lastResize = SDL_GetTicks();
+      resizing = true;
+      requestResize(w / resizeScale, h / resizeScale);
+      redraw = true;
+    }
+
+    if (event.type == SDL_EVENT_WINDOW_EXPOSED) {
+      redraw = true;
+    }
+  };
+
+  // Sleeps in SDL_WaitEvent until input, an expose or a new frame arrives,
+  // so an idle window costs nothing. Frames come at most every
+  // refreshInterval while passes run. The only timed wake-up is the one
+  // that ends a resize.
   while (isRunning) {
     SDL_Event event;
-    while (SDL_PollEvent(&event)) {
-      if (event.type == SDL_EVENT_WINDOW_CLOSE_REQUESTED) {
-        isRunning = false;
+    bool received;
+    if (resizing) {
+      uint64_t elapsed = SDL_GetTicks() - lastResize;
+      int32_t timeout =
+          elapsed < resizeSettle ? static_cast<int32_t>(resizeSettle - elapsed)
+                                 : 0;
+      received = SDL_WaitEventTimeout(&event, timeout);
+    } else {
+      received = SDL_WaitEvent(&event);
+    }
+
+    if (received) {
+      handleEvent(event);
+      while (SDL_PollEvent(&event)) {
+        handleEvent(event);
       }
-      if (event.type == SDL_EVENT_KEY_DOWN &&
-          event.key.scancode == SDL_SCANCODE_ESCAPE) {
-        isRunning = false;
+    }
+
+    if (resizing && SDL_GetTicks() - lastResize >= resizeSettle) {
+      resizing = false;
+      requestResize(w, h);
+    }
+
+    bool upload = false;
+    {
+      std::lock_guard lock{framesMutex};
+      if (frameReady) {
+        std::swap(ready, showing);
+        frameReady = false;
+        upload = true;
       }
     }
+
+    const Frame &frame = frames[showing];
+
+    if (upload && (frame.width > textureWidth || frame.height > textureHeight)) {
+      textureWidth = std::max(textureWidth, frame.width);
+      textureHeight = std::max(textureHeight, frame.height);
+      SDL_DestroyTexture(texture);
+      texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
+                                  SDL_TEXTUREACCESS_STREAMING,
+                                  static_cast<int>(textureWidth),
+                                  static_cast<int>(textureHeight));
+      SDL_ASSERT(texture != nullptr);
+      SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_NONE);
+      SDL_SetTextureAlphaMod(texture, 255);
+    }
+
+    // SDL_UpdateTexture hands the frame straight to the backend with its
+    // own pitch, instead of copying it into a locked staging area first.
+    if (upload) {
+      PROFILE_SCOPE(Upload);
+      SDL_Rect area{0, 0, static_cast<int>(frame.width),
+                    static_cast<int>(frame.height)};
+      SDL_UpdateTexture(texture, &area, frame.pixels.data(),
+                        static_cast<int>(frame.width * sizeof(uint32_t)));
+    }
+
+    if (!upload && !redraw) {
+      continue;
+    }
+    redraw = false;
+
+    SDL_FRect source{0.0f, 0.0f, static_cast<float>(frame.width),
+                     static_cast<float>(frame.height)};
+
     SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
     SDL_RenderClear(renderer);
-    SDL_RenderTexture(renderer, texture, nullptr, nullptr);
+    SDL_RenderTexture(renderer, texture, &source, nullptr);
     SDL_RenderPresent(renderer);
-    SDL_Delay(10);
   }
 
+  {
+    std::lock_guard lock{editsMutex};
+    quitting = true;
+    tracer.cancel();
+    editsReady.notify_one();
+  }
+  renderThread.join();
+
   SDL_DestroyTexture(texture);
   SDL_DestroyRenderer(renderer);
   SDL_DestroyWindow(window);
 
   SDL_Quit();
 
-  return 0;
+  return writeProfile(options) ? 0 : 1;
 }
 
-float randomFloat() {
-  static std::uniform_real_distribution<float> distribution(0.0, 1.0);
-  static std::mt19937 generator;
-  return distribution(generator);
+// WASD/QE move the camera, 1-9 select a sphere, the arrow keys move the
+// selected sphere and M toggles its material between metallic and diffuse.
+bool editFromKey(SDL_Scancode key, uint32_t &selected, SceneEdit &edit) {
+  edit.sphere = selected;
+
+  switch (key) {
+  case SDL_SCANCODE_W:
+    edit.cameraOffset.z = -editStep;
+    return true;
+  case SDL_SCANCODE_S:
+    edit.cameraOffset.z = editStep;
+    return true;
+  case SDL_SCANCODE_A:
+    edit.cameraOffset.x = -editStep;
+    return true;
+  case SDL_SCANCODE_D:
+    edit.cameraOffset.x = editStep;
+    return true;
+  case SDL_SCANCODE_Q:
+    edit.cameraOffset.y = -editStep;
+    return true;
+  case SDL_SCANCODE_E:
+    edit.cameraOffset.y = editStep;
+    return true;
+  case SDL_SCANCODE_LEFT:
+    edit.sphereOffset.x = -editStep;
+    return true;
+  case SDL_SCANCODE_RIGHT:
+    edit.sphereOffset.x = editStep;
+    return true;
+  case SDL_SCANCODE_UP:
+    edit.sphereOffset.z = -editStep;
+    return true;
+  case SDL_SCANCODE_DOWN:
+    edit.sphereOffset.z = editStep;
+    return true;
+  case SDL_SCANCODE_M:
+    edit.toggleMetallic = true;
+    return true;
+  default:
+    break;
+  }
+
+  if (key >= SDL_SCANCODE_1 && key <= SDL_SCANCODE_9) {
+    selected = key - SDL_SCANCODE_1;
+  }
+
+  return false;
 }
 
-float randomFloat(float min, float max) {
-  return min + (max - min) * randomFloat();
+// [ and ] change the exposure, T cycles through the tone curves.
+bool toneMapFromKey(SDL_Scancode key, ToneMapSettings &toneMap) {
+  switch (key) {
+  case SDL_SCANCODE_LEFTBRACKET:
+    toneMap.exposure -= exposureStep;
+    return true;
+  case SDL_SCANCODE_RIGHTBRACKET:
+    toneMap.exposure += exposureStep;
+    return true;
+  case SDL_SCANCODE_T:
+    toneMap.curve = static_cast<ToneCurve>(
+        (static_cast<int>(toneMap.curve) + 1) %
+        (static_cast<int>(ToneCurve::Aces) + 1));
+    return true;
+  default:
+    return false;
+  }
 }
 
-glm::vec2 randomVec2() {
-  return glm::vec2{
-      randomFloat(),
-      randomFloat(),
-  };
+// Runs on the render thread while no pass is in flight. Moving a sphere
+// only refits the BVH; a full rebuild isn't needed until spheres are added
+// or removed.
+void applyEdit(const SceneEdit &edit) {
+  world.camera.position += edit.cameraOffset;
+
+  if (edit.sphere >= world.spheres.size()) {
+    return;
+  }
+
+  Sphere &sphere = world.spheres[edit.sphere];
+
+  if (edit.sphereOffset != glm::vec3{0.0f}) {
+    sphere.center += edit.sphereOffset;
+    world.refit();
+  }
+
+  // Materials are shared, so the sphere gets its own copy first; otherwise
+  // every sphere with the same palette entry would change too.
+  if (edit.toggleMetallic) {
+    uint32_t index = sphere.material;
+    bool shared = std::ranges::any_of(world.spheres, [&](const Sphere &other) {
+      return &other != &sphere && other.material == index;
+    });
+    if (shared) {
+      sphere.material = static_cast<uint32_t>(world.materials.size());
+      world.materials.push_back(world.materials[index]);
+      world.findLights();
+    }
+
+    Material &mat = world.materials[sphere.material];
+    mat.metallic = mat.metallic ? 0.0f : 1.0f;
+  }
+}
+
+bool parseUint(std::string_view text, uint32_t &value) {
+  auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+  return ec == std::errc{} && end == text.data() + text.size();
+}
+
+bool parseFloat(std::string_view text, float &value) {
+  std::string copy{text};
+  char *end;
+  value = std::strtof(copy.c_str(), &end);
+  return !copy.empty() && *end == '\0';
+}
+
+bool parseLayout(std::string_view text, SceneLayout &layout) {
+  for (SceneLayout candidate : sceneLayouts) {
+    if (text == sceneLayoutName(candidate)) {
+      layout = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool parseToneCurve(std::string_view text, ToneCurve &curve) {
+  if (text == "clamp") {
+    curve = ToneCurve::Clamp;
+  } else if (text == "reinhard") {
+    curve = ToneCurve::Reinhard;
+  } else if (text == "aces") {
+    curve = ToneCurve::Aces;
+  } else {
+    return false;
+  }
+  return true;
 }
 
-glm::vec2 randomVec2(float min, float max) {
-  return glm::vec2{randomFloat(min, max), randomFloat(min, max)};
+bool parseSampler(std::string_view text, SamplerKind &kind) {
+  if (text == "sobol") {
+    kind = SamplerKind::Sobol;
+  } else if (text == "random") {
+    kind = SamplerKind::Random;
+  } else {
+    return false;
+  }
+  return true;
 }
 
-glm::vec3 randomVec3() {
-  return glm::vec3{randomFloat(), randomFloat(), randomFloat()};
+// Parses "x0,y0,x1,y1".
+bool parseRegion(std::string_view text, Tile &region) {
+  uint32_t *bounds[] = {&region.x0, &region.y0, &region.x1, &region.y1};
+  for (uint32_t i = 0; i < 4; i++) {
+    size_t comma = i < 3 ? text.find(',') : text.size();
+    if (comma == std::string_view::npos ||
+        !parseUint(text.substr(0, comma), *bounds[i])) {
+      return false;
+    }
+    text.remove_prefix(std::min(comma + 1, text.size()));
+  }
+  return region.x0 < region.x1 && region.y0 < region.y1;
 }
 
-glm::vec3 randomVec3(float min, float max) {
-  return glm::vec3{randomFloat(min, max), randomFloat(min, max),
-                   randomFloat(min, max)};
+bool parseOptions(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg = argv[i];
+
+    if (arg == "--headless") {
+      options.headless = true;
+      continue;
+    }
+
+    if (arg == "--wavefront") {
+      options.wavefront = true;
+      continue;
+    }
+
+    if (arg == "--denoise") {
+      options.denoise = true;
+      continue;
+    }
+
+    if (arg == "--gpu") {
+#ifdef TINYTRACER_GPU
+      options.gpu = true;
+      continue;
+#else
+      fmt::println("--gpu needs a build configured with -DTINYTRACER_GPU=ON.");
+      return false;
+#endif
+    }
+
+    if (i + 1 >= argc) {
+      fmt::println("Usage: RayTracer [--headless] [--wavefront] [--denoise] [--gpu] "
+                   "[--width N] "
+                   "[--height N] "
+                   "[--spp N] [--min-spp N] [--threshold X] [--threads N] "
+                   "[--sampler sobol|random] [--exposure stops] "
+                   "[--tonemap clamp|reinhard|aces] "
+                   "[--output file.png|file.hdr] [--scene file.tts] "
+                   "[--random N] "
+                   "[--layout random|grid|clusters|nested|overlapping] "
+                   "[--write-scene file.tts] "
+                   "[--write-chunked file.ttc] [--chunk-spheres N] "
+                   "[--chunked file.ttc] [--memory-budget MiB] "
+                   "[--trace file.json] [--partial file.ttp] "
+                   "[--first-sample N] [--region x0,y0,x1,y1] "
+                   "[--merge file.ttp]... [--checkpoint file.ttp] "
+                   "[--checkpoint-interval seconds]");
+      return false;
+    }
+
+    std::string_view value = argv[++i];
+    bool valid = true;
+
+    if (arg == "--width") {
+      valid = parseUint(value, options.width);
+    } else if (arg == "--height") {
+      valid = parseUint(value, options.height);
+    } else if (arg == "--spp") {
+      // Zero would count as done before the first pass.
+      valid = parseUint(value, options.sampleCount) && options.sampleCount > 0;
+    } else if (arg == "--min-spp") {
+      valid = parseUint(value, options.minSamples);
+    } else if (arg == "--threshold") {
+      valid = parseFloat(value, options.adaptiveThreshold);
+    } else if (arg == "--threads") {
+      valid = parseUint(value, options.threadCount);
+    } else if (arg == "--output") {
+      options.output = value;
+    } else if (arg == "--scene") {
+      options.scene = value;
+    } else if (arg == "--random") {
+      valid = parseUint(value, options.randomSpheres);
+    } else if (arg == "--layout") {
+      valid = parseLayout(value, options.layout);
+    } else if (arg == "--write-scene") {
+      options.writeScene = value;
+    } else if (arg == "--write-chunked") {
+      options.writeChunked = value;
+    } else if (arg == "--chunk-spheres") {
+      valid = parseUint(value, options.chunkSpheres) && options.chunkSpheres > 0;
+    } else if (arg == "--chunked") {
+      options.chunked = value;
+    } else if (arg == "--memory-budget") {
+      valid = parseUint(value, options.memoryBudget);
+    } else if (arg == "--trace") {
+      options.trace = value;
+    } else if (arg == "--exposure") {
+      valid = parseFloat(value, options.toneMap.exposure);
+    } else if (arg == "--tonemap") {
+      valid = parseToneCurve(value, options.toneMap.curve);
+    } else if (arg == "--sampler") {
+      valid = parseSampler(value, options.sampler);
+    } else if (arg == "--partial") {
+      options.partial = value;
+    } else if (arg == "--first-sample") {
+      valid = parseUint(value, options.firstSample);
+    } else if (arg == "--region") {
+      valid = parseRegion(value, options.region);
+    } else if (arg == "--merge") {
+      options.merge.emplace_back(value);
+    } else if (arg == "--checkpoint") {
+      options.checkpoint = value;
+    } else if (arg == "--checkpoint-interval") {
+      valid = parseUint(value, options.checkpointInterval);
+    } else {
+      fmt::println("Unknown option: {}", arg);
+      return false;
+    }
+
+    if (!valid) {
+      fmt::println("Invalid value for {}: {}", arg, value);
+      return false;
+    }
+  }
+
+  return true;
 }
 
-glm::vec3 randomUnitVec3OnSphere() {
-  while (true) {
-    glm::vec3 dir = randomVec3(-1.0f, 1.0f);
-    float l = glm::dot(dir, dir);
-    if (std::numeric_limits<float>::min() < l && l <= 1) {
-      return dir / glm::sqrt(l);
+bool setupWorld(const Options &options) {
+  // Interactive edits move spheres in world, which a chunked scene doesn't
+  // keep there.
+  if (!options.chunked.empty()) {
+    if (!options.headless) {
+      fmt::println("--chunked needs --headless.");
+      return false;
     }
+    chunkedScene.budget = size_t{options.memoryBudget} << 20;
+    return chunkedScene.open(options.chunked, world);
+  }
+
+  if (!options.scene.empty()) {
+    return loadScene(options.scene, world);
   }
+
+  if (options.randomSpheres > 0) {
+    world = generateScene(options.layout, options.randomSpheres, 1);
+  }
+
+  world.build();
+  return true;
 }
 
-glm::vec2 pixelToWorld(float x, float y) {
-  return {(((2 * ((x + 0.5f) / w)) - 1.0f) * aspectRatio * fov),
-          ((1.0 - (2 * ((y + 0.5f) / h))) * fov)};
+// Renders straight to options.output without touching SDL, for machines
+// with no display.
+int renderHeadless(const Options &options) {
+  if (options.width == 0 || options.height == 0) {
+    fmt::println("Headless rendering needs --width and --height.");
+    return 1;
+  }
+
+  // Only partials record it, and hashing a big scene isn't free.
+  uint64_t sceneId = 0;
+  if (!options.partial.empty() || !options.checkpoint.empty()) {
+    sceneId = sceneFingerprint(
+        world, options.chunked.empty() ? nullptr : &chunkedScene);
+  }
+
+  Renderer tracer{world,
+                  {.width = options.width,
+                   .height = options.height,
+                   .sampleCount = options.sampleCount,
+                   .minSamples = options.minSamples,
+                   .adaptiveThreshold = options.adaptiveThreshold,
+                   .wavefront = options.wavefront,
+                   .threadCount = options.threadCount,
+                   .region = options.region,
+                   .firstSample = options.firstSample,
+                   .sceneId = sceneId,
+                   .denoise = options.denoise,
+                   .sampler = options.sampler,
+                   .toneMap = options.toneMap}};
+
+  if (!options.chunked.empty()) {
+    tracer.setChunkedScene(&chunkedScene);
+  }
+
+  std::optional<Checkpoint> checkpoint;
+  if (!options.checkpoint.empty()) {
+    checkpoint.emplace(options.checkpoint,
+                       std::chrono::seconds{options.checkpointInterval});
+    if (!checkpoint->resume(tracer)) {
+      return 1;
+    }
+  }
+
+  while (!tracer.done()) {
+    tracer.renderPass();
+    if (checkpoint) {
+      checkpoint->update(tracer);
+    }
+  }
+
+  if (checkpoint && !checkpoint->finish(tracer)) {
+    return 1;
+  }
+
+  Tile region = tracer.region();
+  fmt::println("{} samples over {} passes ({:.1f} spp average)",
+               tracer.samples(), tracer.passes(),
+               static_cast<double>(tracer.samples()) /
+                   (static_cast<double>(region.x1 - region.x0) *
+                    (region.y1 - region.y0)));
+
+  if (!options.chunked.empty()) {
+    fmt::println("{}: {} chunks, {} page-ins, {} evictions, {:.1f} MiB "
+                 "resident at the end",
+                 options.chunked, chunkedScene.chunkCount(),
+                 chunkedScene.pageIns(), chunkedScene.evictions(),
+                 static_cast<double>(chunkedScene.residentBytes()) /
+                     (1 << 20));
+  }
+
+  if (!options.partial.empty()) {
+    if (!savePartial(options.partial, tracer)) {
+      return 1;
+    }
+
+    fmt::println("Wrote samples {}..{} of ({}, {})-({}, {}) to {}",
+                 options.firstSample,
+                 options.firstSample + options.sampleCount, region.x0,
+                 region.y0, region.x1, region.y1, options.partial);
+    return writeProfile(options) ? 0 : 1;
+  }
+
+  if (!writeImage(options.output, tracer)) {
+    fmt::println("Failed to write {}", options.output);
+    return 1;
+  }
+
+  fmt::println("Wrote {}x{} at {} spp to {}", options.width, options.height,
+               options.sampleCount, options.output);
+  return writeProfile(options) ? 0 : 1;
 }
 
-bool nearZero(const glm::vec3& vec) {
-  constexpr float e = std::numeric_limits<float>::epsilon();
-  return glm::abs(vec.r) < e && glm::abs(vec.g) < e && glm::abs(vec.b) < e;
-};
+// Coordinator side of a distributed render: sums every partial into one
+// renderer and resolves it, without tracing anything. The world is never
+// used, so no scene is needed.
+int mergePartials(const Options &options) {
+  std::vector<PartialFileHeader> headers;
+  if (!readPartialHeaders(options.merge, headers)) {
+    return 1;
+  }
+  uint32_t width = headers.front().width;
+  uint32_t height = headers.front().height;
+
+  Renderer tracer{world,
+                  {.width = width,
+                   .height = height,
+                   .threadCount = options.threadCount,
+                   .toneMap = options.toneMap}};
+
+  for (const std::string &path : options.merge) {
+    if (!mergePartial(path, tracer)) {
+      return 1;
+    }
+  }
+
+  if (!writeImage(options.output, tracer)) {
+    fmt::println("Failed to write {}", options.output);
+    return 1;
+  }
+
+  fmt::println("Merged {} partials into {}x{} ({:.1f} spp average), wrote {}",
+               options.merge.size(), width, height,
+               static_cast<double>(tracer.samples()) /
+                   (static_cast<double>(width) * height),
+               options.output);
+  return 0;
+}
+
+bool writeProfile(const Options &options) {
+  if (options.trace.empty()) {
+    return true;
+  }
+
+  printProfile();
+  return writeTrace(options.trace);
+}
+
+#ifdef TINYTRACER_GPU
+
+// Interactive loop for the GPU backend. SDL_GPU owns the window here, so
+// there is no SDL_Renderer; passes are queued from the event loop and the
+// display texture is blitted to the swapchain after each one. The window
+// can be resized but the render keeps its initial resolution.
+int renderGpu(const Options &options) {
+  SDL_ASSERT(SDL_Init(SDL_INIT_VIDEO));
+
+  int displaysCount;
+  SDL_DisplayID *displays = SDL_GetDisplays(&displaysCount);
+  SDL_ASSERT(displays != nullptr);
+
+  const SDL_DisplayMode *displayMode = SDL_GetCurrentDisplayMode(displays[0]);
+  SDL_ASSERT(displayMode != nullptr);
+
+  w = options.width ? options.width : displayMode->w / 3;
+  h = options.height ? options.height : displayMode->h / 3;
+
+  SDL_Window *window =
+      SDL_CreateWindow("tinytracer (gpu)", static_cast<int>(w),
+                       static_cast<int>(h), SDL_WINDOW_RESIZABLE);
+  SDL_ASSERT(window != nullptr);
+
+  GpuRenderer gpu;
+  if (!gpu.open(world,
+                {.width = w, .height = h, .sampleCount = options.sampleCount},
+                window)) {
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    return 1;
+  }
+
+  bool isRunning = true;
+  uint32_t selected = 0;
+  bool redraw = true;
+
+  // Polls while passes remain, since each one presents. Once the render is
+  // done it blocks in SDL_WaitEvent and presents only on an expose or
+  // resize.
+  while (isRunning) {
+    SDL_Event event;
+    bool received = gpu.done() ? SDL_WaitEvent(&event) : SDL_PollEvent(&event);
+    for (; received; received = SDL_PollEvent(&event)) {
+      if (event.type == SDL_EVENT_WINDOW_EXPOSED ||
+          event.type == SDL_EVENT_WINDOW_RESIZED) {
+        redraw = true;
+      }
+      if (event.type == SDL_EVENT_WINDOW_CLOSE_REQUESTED) {
+        isRunning = false;
+      }
+      if (event.type == SDL_EVENT_KEY_DOWN &&
+          event.key.scancode == SDL_SCANCODE_ESCAPE) {
+        isRunning = false;
+      }
+
+      SceneEdit edit;
+      if (event.type == SDL_EVENT_KEY_DOWN &&
+          editFromKey(event.key.scancode, selected, edit)) {
+        applyEdit(edit);
+        bool sceneChanged =
+            edit.sphereOffset != glm::vec3{0.0f} || edit.toggleMetallic;
+        if (sceneChanged) {
+          gpu.upload(world);
+        } else {
+          gpu.reset();
+        }
+      }
+    }
+
+    if (gpu.done()) {
+      if (redraw) {
+        gpu.present();
+        redraw = false;
+      }
+      continue;
+    }
+
+    gpu.renderPass(world.camera);
+    gpu.present();
+    redraw = false;
+  }
+
+  gpu.close();
+  SDL_DestroyWindow(window);
+  SDL_Quit();
+
+  return 0;
+}
+
+#else
+
+int renderGpu(const Options &) { return 1; }
+
+#endif
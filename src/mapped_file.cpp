@@ -0,0 +1,132 @@
+#include "mapped_file.h"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() { close(); }
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string &path) {
+  close();
+
+  file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                     OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    file = nullptr;
+    return false;
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+    close();
+    return false;
+  }
+
+  mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping == nullptr) {
+    close();
+    return false;
+  }
+
+  bytes = static_cast<const uint8_t *>(
+      MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  if (bytes == nullptr) {
+    close();
+    return false;
+  }
+
+  length = static_cast<size_t>(size.QuadPart);
+  return true;
+}
+
+void MappedFile::close() {
+  if (bytes != nullptr) {
+    UnmapViewOfFile(bytes);
+  }
+  if (mapping != nullptr) {
+    CloseHandle(mapping);
+  }
+  if (file != nullptr) {
+    CloseHandle(file);
+  }
+
+  bytes = nullptr;
+  length = 0;
+  mapping = nullptr;
+  file = nullptr;
+}
+
+// Unlocking pages that were never locked takes them out of the working
+// set; clean file pages are then reclaimed first under memory pressure.
+void MappedFile::discard(size_t offset, size_t size) const {
+  if (bytes != nullptr && offset < length) {
+    VirtualUnlock(const_cast<uint8_t *>(bytes + offset),
+                  std::min(size, length - offset));
+  }
+}
+
+#else
+
+bool MappedFile::open(const std::string &path) {
+  close();
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    ::close(fd);
+    return false;
+  }
+
+  void *address = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ,
+                       MAP_PRIVATE, fd, 0);
+  ::close(fd);
+
+  if (address == MAP_FAILED) {
+    return false;
+  }
+
+  bytes = static_cast<const uint8_t *>(address);
+  length = static_cast<size_t>(info.st_size);
+  return true;
+}
+
+void MappedFile::close() {
+  if (bytes != nullptr) {
+    munmap(const_cast<uint8_t *>(bytes), length);
+  }
+
+  bytes = nullptr;
+  length = 0;
+}
+
+// madvise() wants a page-aligned start, so the partial pages at either end
+// are left alone.
+void MappedFile::discard(size_t offset, size_t size) const {
+  if (bytes == nullptr || offset >= length) {
+    return;
+  }
+
+  size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t begin = (offset + page - 1) / page * page;
+  size_t end = std::min(offset + size, length) / page * page;
+  if (begin < end) {
+    madvise(const_cast<uint8_t *>(bytes + begin), end - begin, MADV_DONTNEED);
+  }
+}
+
+#endif
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only view of a whole file, mapped into memory by the OS.
+class MappedFile {
+public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool open(const std::string &path);
+  void close();
+
+  const uint8_t *data() const { return bytes; }
+  size_t size() const { return length; }
+
+  // Hints that [offset, offset + size) won't be read again soon, so the OS
+  // can drop those pages from the working set. The bytes stay readable.
+  void discard(size_t offset, size_t size) const;
+
+private:
+  const uint8_t *bytes = nullptr;
+  size_t length = 0;
+
+#ifdef _WIN32
+  void *file = nullptr;
+  void *mapping = nullptr;
+#endif
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "ray.h"
+
+constexpr uint32_t packetSize = 8;
+
+// A bundle of coherent rays traced through the BVH together, stored one
+// array per component so the per-lane loops vectorize. Only the first
+// count lanes are live.
+struct RayPacket {
+  float originX[packetSize] = {};
+  float originY[packetSize] = {};
+  float originZ[packetSize] = {};
+  float directionX[packetSize] = {};
+  float directionY[packetSize] = {};
+  float directionZ[packetSize] = {};
+  uint32_t count = 0;
+
+  void set(uint32_t lane, const Ray &ray) {
+    originX[lane] = ray.origin.x;
+    originY[lane] = ray.origin.y;
+    originZ[lane] = ray.origin.z;
+    directionX[lane] = ray.direction.x;
+    directionY[lane] = ray.direction.y;
+    directionZ[lane] = ray.direction.z;
+  }
+
+  Ray ray(uint32_t lane) const {
+    return Ray{{originX[lane], originY[lane], originZ[lane]},
+               {directionX[lane], directionY[lane], directionZ[lane]}};
+  }
+};
@@ -0,0 +1,304 @@
+#include "partial_file.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fmt/core.h>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "mapped_file.h"
+
+static_assert(std::is_trivially_copyable_v<PixelSums>);
+static_assert(sizeof(PixelSums) == 20);
+static_assert(std::is_trivially_copyable_v<FirstHit>);
+static_assert(sizeof(FirstHit) == 24);
+static_assert(sizeof(PartialFileHeader) == 72);
+
+namespace {
+
+bool readHeader(const std::string &path, const MappedFile &file,
+                PartialFileHeader &header) {
+  if (file.size() < sizeof(header)) {
+    fmt::println("{} is not a partial render", path);
+    return false;
+  }
+  std::memcpy(&header, file.data(), sizeof(header));
+
+  if (std::memcmp(header.magic, partialFileMagic, sizeof(header.magic)) != 0) {
+    fmt::println("{} is not a partial render", path);
+    return false;
+  }
+
+  if (header.version != partialFileVersion) {
+    fmt::println("{} has version {}, expected {}", path, header.version,
+                 partialFileVersion);
+    return false;
+  }
+
+  // Pixel indices are 32-bit throughout the renderer, so a larger frame
+  // would wrap both its buffer sizes and the indices into them.
+  if (uint64_t{header.width} * header.height >
+      std::numeric_limits<uint32_t>::max()) {
+    fmt::println("{} is {}x{}, larger than any frame that can be rendered",
+                 path, header.width, header.height);
+    return false;
+  }
+
+  bool inFrame = header.x0 < header.x1 && header.x1 <= header.width &&
+                 header.y0 < header.y1 && header.y1 <= header.height;
+  uint64_t pixels = uint64_t{header.x1 - header.x0} * (header.y1 - header.y0);
+  uint64_t pixelBytes =
+      sizeof(PixelSums) + (header.guides != 0 ? sizeof(FirstHit) : 0);
+  if (!inFrame || header.guides > 1 ||
+      pixels * pixelBytes > file.size() - sizeof(header)) {
+    fmt::println("{} is truncated or corrupt", path);
+    return false;
+  }
+
+  return true;
+}
+
+// The body is only 4-byte aligned, so every entry is copied rather than
+// cast. readHeader() bounds the frame, so indices into it can't wrap.
+void addSums(const MappedFile &file, const PartialFileHeader &header,
+             Renderer &renderer) {
+  const uint8_t *data = file.data() + sizeof(header);
+  for (uint32_t y = header.y0; y < header.y1; y++) {
+    for (uint32_t x = header.x0; x < header.x1; x++) {
+      PixelSums sums;
+      std::memcpy(&sums, data, sizeof(sums));
+      data += sizeof(sums);
+      renderer.addPixelSums(y * header.width + x, sums);
+    }
+  }
+}
+
+// Same layout as addSums(), right after the pixel sums.
+void addGuides(const MappedFile &file, const PartialFileHeader &header,
+               Renderer &renderer) {
+  uint64_t pixels = uint64_t{header.x1 - header.x0} * (header.y1 - header.y0);
+  const uint8_t *data =
+      file.data() + sizeof(header) + pixels * sizeof(PixelSums);
+  for (uint32_t y = header.y0; y < header.y1; y++) {
+    for (uint32_t x = header.x0; x < header.x1; x++) {
+      FirstHit sums;
+      std::memcpy(&sums, data, sizeof(sums));
+      data += sizeof(sums);
+      renderer.addGuideSums(y * header.width + x, sums);
+    }
+  }
+}
+
+// FNV-1a, over the raw bytes of types the scene files already write as is.
+uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+  }
+  return hash;
+}
+
+} // namespace
+
+void snapshotPartial(const Renderer &renderer, PartialSnapshot &snapshot) {
+  const RenderSettings &settings = renderer.settings;
+  Tile region = renderer.region();
+
+  PartialFileHeader &header = snapshot.header;
+  header = {};
+  std::memcpy(header.magic, partialFileMagic, sizeof(header.magic));
+  header.version = partialFileVersion;
+  header.width = settings.width;
+  header.height = settings.height;
+  header.x0 = region.x0;
+  header.y0 = region.y0;
+  header.x1 = region.x1;
+  header.y1 = region.y1;
+  header.firstSample = settings.firstSample;
+  header.sampleCount = settings.sampleCount;
+  header.passCount = renderer.passes();
+  header.sampler = static_cast<uint32_t>(settings.sampler);
+  header.minSamples = settings.minSamples;
+  header.adaptiveThreshold = settings.adaptiveThreshold;
+  header.guides = renderer.hasGuides() ? 1 : 0;
+  header.sceneId = settings.sceneId;
+
+  uint32_t regionWidth = region.x1 - region.x0;
+  uint32_t pixels = regionWidth * (region.y1 - region.y0);
+  snapshot.pixels.resize(pixels);
+  snapshot.guides.resize(renderer.hasGuides() ? pixels : 0);
+
+  PixelSums *out = snapshot.pixels.data();
+  FirstHit *guides = snapshot.guides.data();
+  for (uint32_t y = region.y0; y < region.y1; y++) {
+    for (uint32_t x = region.x0; x < region.x1; x++) {
+      uint32_t idx = y * settings.width + x;
+      *out++ = renderer.pixelSums(idx);
+      if (renderer.hasGuides()) {
+        *guides++ = renderer.guideSums(idx);
+      }
+    }
+  }
+}
+
+bool writePartial(const std::string &path, const PartialSnapshot &snapshot) {
+  std::FILE *file = std::fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    fmt::println("Failed to open {} for writing", path);
+    return false;
+  }
+
+  size_t count = snapshot.pixels.size();
+  size_t guideCount = snapshot.guides.size();
+  bool ok = std::fwrite(&snapshot.header, sizeof(snapshot.header), 1, file) ==
+                1 &&
+            std::fwrite(snapshot.pixels.data(), sizeof(PixelSums), count,
+                        file) == count &&
+            std::fwrite(snapshot.guides.data(), sizeof(FirstHit), guideCount,
+                        file) == guideCount;
+
+  ok = std::fclose(file) == 0 && ok;
+  if (!ok) {
+    fmt::println("Failed to write {}", path);
+  }
+  return ok;
+}
+
+uint64_t sceneFingerprint(const World &world, const ChunkedScene *chunked) {
+  uint64_t hash = 0xCBF29CE484222325ull;
+  hash = hashBytes(hash, &world.camera, sizeof(world.camera));
+  hash = hashBytes(hash, world.materials.data(),
+                   world.materials.size() * sizeof(Material));
+  hash = hashBytes(hash, world.spheres.data(),
+                   world.spheres.size() * sizeof(Sphere));
+  hash = hashBytes(hash, world.lights.data(),
+                   world.lights.size() * sizeof(Sphere));
+
+  if (chunked != nullptr) {
+    uint64_t counts[2] = {chunked->sphereCount(), chunked->chunkCount()};
+    hash = hashBytes(hash, counts, sizeof(counts));
+  }
+  return hash;
+}
+
+bool savePartial(const std::string &path, const Renderer &renderer) {
+  PartialSnapshot snapshot;
+  snapshotPartial(renderer, snapshot);
+  return writePartial(path, snapshot);
+}
+
+bool readPartialHeaders(const std::vector<std::string> &paths,
+                        std::vector<PartialFileHeader> &headers) {
+  headers.resize(paths.size());
+  for (size_t i = 0; i < paths.size(); i++) {
+    MappedFile file;
+    if (!file.open(paths[i])) {
+      fmt::println("Failed to map {}", paths[i]);
+      return false;
+    }
+    if (!readHeader(paths[i], file, headers[i])) {
+      return false;
+    }
+  }
+
+  for (size_t i = 1; i < headers.size(); i++) {
+    const PartialFileHeader &a = headers.front();
+    const PartialFileHeader &b = headers[i];
+    if (b.width != a.width || b.height != a.height) {
+      fmt::println("{} is {}x{}, expected {}x{}", paths[i], b.width, b.height,
+                   a.width, a.height);
+      return false;
+    }
+    if (b.sampler != a.sampler || b.sceneId != a.sceneId) {
+      fmt::println("{} and {} were rendered with different scenes or "
+                   "samplers",
+                   paths.front(), paths[i]);
+      return false;
+    }
+  }
+
+  for (size_t i = 0; i < headers.size(); i++) {
+    for (size_t j = i + 1; j < headers.size(); j++) {
+      const PartialFileHeader &a = headers[i];
+      const PartialFileHeader &b = headers[j];
+      bool regions = a.x0 < b.x1 && b.x0 < a.x1 && a.y0 < b.y1 && b.y0 < a.y1;
+      bool samples =
+          a.firstSample < uint64_t{b.firstSample} + b.sampleCount &&
+          b.firstSample < uint64_t{a.firstSample} + a.sampleCount;
+      if (regions && samples) {
+        fmt::println("{} and {} both hold samples {}..{} of part of the frame",
+                     paths[i], paths[j],
+                     std::max(a.firstSample, b.firstSample),
+                     std::min(uint64_t{a.firstSample} + a.sampleCount,
+                              uint64_t{b.firstSample} + b.sampleCount));
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+bool mergePartial(const std::string &path, Renderer &renderer) {
+  MappedFile file;
+  if (!file.open(path)) {
+    fmt::println("Failed to map {}", path);
+    return false;
+  }
+
+  PartialFileHeader header;
+  if (!readHeader(path, file, header)) {
+    return false;
+  }
+
+  const RenderSettings &settings = renderer.settings;
+  if (header.width != settings.width || header.height != settings.height) {
+    fmt::println("{} is {}x{}, expected {}x{}", path, header.width,
+                 header.height, settings.width, settings.height);
+    return false;
+  }
+
+  addSums(file, header, renderer);
+  return true;
+}
+
+bool resumePartial(const std::string &path, Renderer &renderer) {
+  MappedFile file;
+  if (!file.open(path)) {
+    fmt::println("Failed to map {}", path);
+    return false;
+  }
+
+  PartialFileHeader header;
+  if (!readHeader(path, file, header)) {
+    return false;
+  }
+
+  const RenderSettings &settings = renderer.settings;
+  Tile region = renderer.region();
+  bool matches = header.width == settings.width &&
+                 header.height == settings.height && header.x0 == region.x0 &&
+                 header.y0 == region.y0 && header.x1 == region.x1 &&
+                 header.y1 == region.y1 &&
+                 header.firstSample == settings.firstSample &&
+                 header.sampleCount == settings.sampleCount &&
+                 header.sampler == static_cast<uint32_t>(settings.sampler) &&
+                 header.minSamples == settings.minSamples &&
+                 header.adaptiveThreshold == settings.adaptiveThreshold &&
+                 header.sceneId == settings.sceneId &&
+                 (header.guides != 0 || !renderer.hasGuides());
+  if (!matches) {
+    fmt::println("{} was written by a render with different settings", path);
+    return false;
+  }
+
+  renderer.reset();
+  addSums(file, header, renderer);
+  if (renderer.hasGuides()) {
+    addGuides(file, header, renderer);
+  }
+  renderer.restorePasses(header.passCount);
+  return true;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "renderer.h"
+
+// Partial render format (.ttp) for splitting a frame across machines. Every
+// worker renders the same .tts scene headless, either a different region
+// of the frame or a different sample range (--first-sample) of the whole
+// frame, and writes its raw sums here; a coordinator adds them together
+// and resolves the image once. Samples are seeded by pixel and sample
+// index, so the merged image matches a single-machine render of the
+// combined samples up to the rounding of the final additions.
+//
+// The same file doubles as a headless render's checkpoint, see
+// checkpoint.h.
+//
+// A fixed header is followed by one PixelSums per pixel of the region, row
+// by row, and, when the render was denoised, one FirstHit of guide sums per
+// pixel in the same order. All values are little-endian.
+constexpr char partialFileMagic[8] = {'T', 'T', 'P', 'A', 'R', 'T', '\0', '\0'};
+constexpr uint32_t partialFileVersion = 3;
+
+struct PartialFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  uint32_t x0, y0;
+  uint32_t x1, y1;
+  uint32_t firstSample;
+  uint32_t sampleCount;
+  // Completed passes, for resuming; merging ignores it.
+  uint32_t passCount;
+  // What the samples were drawn with; samples of different samplers or
+  // scenes are never mixed, and a resumed render needs the same adaptive
+  // settings too.
+  uint32_t sampler;
+  uint32_t minSamples;
+  float adaptiveThreshold;
+  // 1 when the guide sums follow the pixel sums.
+  uint32_t guides;
+  uint64_t sceneId;
+};
+
+// A copy of a renderer's region, taken between passes so it can be
+// written out while rendering goes on.
+struct PartialSnapshot {
+  PartialFileHeader header;
+  std::vector<PixelSums> pixels;
+  // Empty unless header.guides is set.
+  std::vector<FirstHit> guides;
+};
+
+// Reuses snapshot's storage when the region size hasn't changed.
+void snapshotPartial(const Renderer &renderer, PartialSnapshot &snapshot);
+bool writePartial(const std::string &path, const PartialSnapshot &snapshot);
+
+// Identifies the scene a render sees, for RenderSettings::sceneId: a hash of
+// the camera, materials and spheres. A chunked scene only keeps its lights
+// in world, so its sphere and chunk counts stand in for the rest, and the
+// same scene saved as .tts and as .ttc gets different ids.
+uint64_t sceneFingerprint(const World &world, const ChunkedScene *chunked);
+
+// Writes the sums of renderer's region.
+bool savePartial(const std::string &path, const Renderer &renderer);
+
+// Reads the headers of every partial of a merge before any sums are added,
+// so a coordinator can size its renderer. Fails unless all of them share
+// the frame size, sampler and scene, and no two cover the same samples of
+// a pixel, which would count those samples twice.
+bool readPartialHeaders(const std::vector<std::string> &paths,
+                        std::vector<PartialFileHeader> &headers);
+
+// Adds the sums in path to renderer, which must have the same frame size.
+bool mergePartial(const std::string &path, Renderer &renderer);
+
+// Continues a render from a partial of exactly the same scene, frame,
+// region, sample range and sampling settings: resets renderer, loads the
+// sums, the guide sums when denoising and the pass count and recomputes
+// which pixels have converged.
+bool resumePartial(const std::string &path, Renderer &renderer);
@@ -0,0 +1,155 @@
+#include "profile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fmt/core.h>
+#include <memory>
+#include <mutex>
+
+namespace {
+
+const char *phaseNames[phaseCount] = {"pass",   "tile", "resolve", "upload",
+                                      "rayGen", "hit",  "scatter"};
+const char *counterNames[counterCount] = {
+    "rays", "intersectionTests", "paths", "bounces", "rngDraws"};
+
+#ifdef TINYTRACER_PROFILE
+
+std::mutex registryMutex;
+std::vector<std::unique_ptr<ThreadProfile>> registry;
+
+#endif
+
+} // namespace
+
+const char *phaseName(Phase phase) {
+  return phaseNames[static_cast<uint32_t>(phase)];
+}
+
+const char *counterName(Counter counter) {
+  return counterNames[static_cast<uint32_t>(counter)];
+}
+
+#ifdef TINYTRACER_PROFILE
+
+ThreadProfile &registerProfileThread() {
+  std::lock_guard lock{registryMutex};
+  registry.push_back(std::make_unique<ThreadProfile>());
+  registry.back()->thread = static_cast<uint32_t>(registry.size());
+  return *registry.back();
+}
+
+uint64_t profileClock() {
+  using Clock = std::chrono::steady_clock;
+  static const Clock::time_point epoch = Clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                              epoch)
+      .count();
+}
+
+// Reads other threads' totals without stopping them, so a snapshot taken
+// mid-pass may be slightly behind; take it between passes for exact numbers.
+ProfileTotals profileTotals() {
+  ProfileTotals sum;
+  std::lock_guard lock{registryMutex};
+
+  for (const auto &profile : registry) {
+    for (uint32_t i = 0; i < counterCount; i++) {
+      sum.counters[i] += profile->totals.counters[i];
+    }
+    for (uint32_t i = 0; i < phaseCount; i++) {
+      sum.phaseNanoseconds[i] += profile->totals.phaseNanoseconds[i];
+      sum.phaseCalls[i] += profile->totals.phaseCalls[i];
+    }
+  }
+
+  return sum;
+}
+
+void printProfile() {
+  ProfileTotals totals = profileTotals();
+
+  fmt::println("{:<12} {:>12} {:>14} {:>10}", "phase", "calls", "total ms",
+               "ns/call");
+  for (uint32_t i = 0; i < phaseCount; i++) {
+    uint64_t calls = totals.phaseCalls[i];
+    double ms = totals.phaseNanoseconds[i] / 1e6;
+    fmt::println("{:<12} {:>12} {:>14.3f} {:>10.1f}", phaseNames[i], calls, ms,
+                 calls ? static_cast<double>(totals.phaseNanoseconds[i]) / calls
+                       : 0.0);
+  }
+
+  for (uint32_t i = 0; i < counterCount; i++) {
+    fmt::println("{:<18} {:>14}", counterNames[i], totals.counters[i]);
+  }
+
+  double paths = static_cast<double>(totals.counter(Counter::Paths));
+  if (paths > 0) {
+    fmt::println("mean path depth    {:>14.2f}",
+                 totals.counter(Counter::Bounces) / paths);
+    fmt::println("rays per path      {:>14.2f}",
+                 totals.counter(Counter::Rays) / paths);
+  }
+}
+
+bool writeTrace(const std::string &path) {
+  std::FILE *file = std::fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    fmt::println("Failed to open {}", path);
+    return false;
+  }
+
+  std::lock_guard lock{registryMutex};
+
+  // Complete ("X") events in microseconds, one track per thread, with each
+  // thread's counters as a final counter ("C") event.
+  fmt::print(file, "{{\"traceEvents\": [");
+  bool first = true;
+
+  for (const auto &profile : registry) {
+    uint64_t end = 0;
+
+    for (const TraceEvent &event : profile->events) {
+      fmt::print(file,
+                 "{}\n{{\"name\": \"{}\", \"ph\": \"X\", \"pid\": 1, "
+                 "\"tid\": {}, \"ts\": {:.3f}, \"dur\": {:.3f}}}",
+                 first ? "" : ",", phaseName(event.phase), profile->thread,
+                 event.start / 1e3, event.duration / 1e3);
+      first = false;
+      end = std::max(end, event.start + event.duration);
+    }
+
+    fmt::print(file,
+               "{}\n{{\"name\": \"counters\", \"ph\": \"C\", \"pid\": 1, "
+               "\"tid\": {}, \"ts\": {:.3f}, \"args\": {{",
+               first ? "" : ",", profile->thread, end / 1e3);
+    first = false;
+
+    for (uint32_t i = 0; i < counterCount; i++) {
+      fmt::print(file, "{}\"{}\": {}", i ? ", " : "", counterNames[i],
+                 profile->totals.counters[i]);
+    }
+    fmt::print(file, "}}}}");
+  }
+
+  fmt::print(file, "\n]}}\n");
+  return std::fclose(file) == 0;
+}
+
+#else
+
+ProfileTotals profileTotals() { return {}; }
+
+void printProfile() {
+  fmt::println("Profiling is disabled; configure with -DTINYTRACER_PROFILE=ON.");
+}
+
+bool writeTrace(const std::string &path) {
+  fmt::println("Can't write {}: profiling is disabled; configure with "
+               "-DTINYTRACER_PROFILE=ON.",
+               path);
+  return false;
+}
+
+#endif
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Optional instrumentation. Configure with TINYTRACER_PROFILE to get
+// per-thread counters, per-phase timers and a Chrome trace export; without
+// it PROFILE_COUNT and PROFILE_SCOPE expand to nothing and the hot paths
+// compile exactly as before.
+
+// Phases before RayGen are coarse enough to be recorded as trace events.
+// The per-ray phases after it only accumulate time and call counts, since
+// one event per ray would dwarf the work being measured.
+enum class Phase : uint32_t {
+  Pass,
+  Tile,
+  Resolve,
+  Upload,
+  RayGen,
+  Hit,
+  Scatter,
+  Count,
+};
+
+enum class Counter : uint32_t {
+  Rays,
+  IntersectionTests,
+  Paths,
+  Bounces,
+  RngDraws,
+  Count,
+};
+
+constexpr uint32_t phaseCount = static_cast<uint32_t>(Phase::Count);
+constexpr uint32_t counterCount = static_cast<uint32_t>(Counter::Count);
+
+const char *phaseName(Phase phase);
+const char *counterName(Counter counter);
+
+struct ProfileTotals {
+  uint64_t counters[counterCount] = {};
+  uint64_t phaseNanoseconds[phaseCount] = {};
+  uint64_t phaseCalls[phaseCount] = {};
+
+  uint64_t counter(Counter c) const {
+    return counters[static_cast<uint32_t>(c)];
+  }
+};
+
+// Sums every thread's counters and timers so far. All zero when profiling
+// is compiled out. Like writeTrace(), meant to run while no pass is in
+// flight.
+ProfileTotals profileTotals();
+
+// Prints profileTotals() as a table, including rays per path and mean path
+// depth. Prints a note instead when profiling is compiled out.
+void printProfile();
+
+// Writes the recorded events as Chrome trace / Perfetto JSON. Fails when
+// profiling is compiled out.
+bool writeTrace(const std::string &path);
+
+#ifdef TINYTRACER_PROFILE
+
+struct TraceEvent {
+  Phase phase;
+  uint64_t start;
+  uint64_t duration;
+};
+
+// Each thread writes only its own ThreadProfile; they are owned by a global
+// registry so the totals survive the thread.
+struct ThreadProfile {
+  uint32_t thread;
+  ProfileTotals totals;
+  std::vector<TraceEvent> events;
+};
+
+ThreadProfile &registerProfileThread();
+
+inline ThreadProfile &threadProfile() {
+  thread_local ThreadProfile &profile = registerProfileThread();
+  return profile;
+}
+
+// Nanoseconds since the first call in the process.
+uint64_t profileClock();
+
+class ProfileScope {
+public:
+  explicit ProfileScope(Phase phase) : phase{phase}, start{profileClock()} {}
+
+  ~ProfileScope() {
+    uint64_t duration = profileClock() - start;
+    ThreadProfile &profile = threadProfile();
+    uint32_t i = static_cast<uint32_t>(phase);
+    profile.totals.phaseNanoseconds[i] += duration;
+    profile.totals.phaseCalls[i]++;
+
+    if (phase < Phase::RayGen) {
+      profile.events.push_back({phase, start, duration});
+    }
+  }
+
+  ProfileScope(const ProfileScope &) = delete;
+  ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+  Phase phase;
+  uint64_t start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#define PROFILE_COUNT(counter, n)                                              \
+  (threadProfile()                                                             \
+       .totals.counters[static_cast<uint32_t>(Counter::counter)] += (n))
+#define PROFILE_SCOPE(phase)                                                   \
+  ProfileScope PROFILE_CONCAT(profileScope, __LINE__) { Phase::phase }
+
+#else
+
+#define PROFILE_COUNT(counter, n) ((void)0)
+#define PROFILE_SCOPE(phase) ((void)0)
+
+#endif
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "profile.h"
+
+// PCG32 (O'Neill, pcg-random.org): 16 bytes of state, one multiply-add per
+// draw. Seeding from (pixel, sample) makes every sample's random sequence
+// independent of which thread renders it or in which order.
+struct Rng {
+  uint64_t state;
+  uint64_t inc;
+
+  Rng(uint64_t seed = 0, uint64_t stream = 0) : state{0}, inc{(stream << 1) | 1} {
+    next();
+    state += seed;
+    next();
+  }
+
+  uint32_t next() {
+    uint64_t old = state;
+    state = old * 6364136223846793005ULL + inc;
+    uint32_t xorShifted = static_cast<uint32_t>(((old >> 18) ^ old) >> 27);
+    uint32_t rot = static_cast<uint32_t>(old >> 59);
+    return (xorShifted >> rot) | (xorShifted << ((-rot) & 31));
+  }
+};
+
+inline Rng pixelRng(uint32_t pixel, uint32_t sample) {
+  return Rng{static_cast<uint64_t>(pixel) << 32 | sample, pixel};
+}
+
+// Top 24 bits scaled into [0, 1); exact in a float mantissa.
+inline float randomFloat(Rng &rng) {
+  PROFILE_COUNT(RngDraws, 1);
+  return static_cast<float>(rng.next() >> 8) * 0x1p-24f;
+}
+
+inline float randomFloat(Rng &rng, float min, float max) {
+  return min + (max - min) * randomFloat(rng);
+}
+
+inline glm::vec2 randomVec2(Rng &rng) {
+  float x = randomFloat(rng);
+  float y = randomFloat(rng);
+  return glm::vec2{x, y};
+}
+
+inline glm::vec2 randomVec2(Rng &rng, float min, float max) {
+  float x = randomFloat(rng, min, max);
+  float y = randomFloat(rng, min, max);
+  return glm::vec2{x, y};
+}
+
+inline glm::vec3 randomVec3(Rng &rng) {
+  float x = randomFloat(rng);
+  float y = randomFloat(rng);
+  float z = randomFloat(rng);
+  return glm::vec3{x, y, z};
+}
+
+inline glm::vec3 randomVec3(Rng &rng, float min, float max) {
+  float x = randomFloat(rng, min, max);
+  float y = randomFloat(rng, min, max);
+  float z = randomFloat(rng, min, max);
+  return glm::vec3{x, y, z};
+}
+
+// Closed-form warps from [0, 1)^2; no rejection loop, so every direction
+// costs exactly two draws.
+
+inline glm::vec3 uniformSphere(const glm::vec2 &u) {
+  float z = 1.0f - 2.0f * u.x;
+  float r = glm::sqrt(glm::max(0.0f, 1.0f - z * z));
+  float phi = glm::two_pi<float>() * u.y;
+  return {r * glm::cos(phi), r * glm::sin(phi), z};
+}
+
+// Completes the unit vector n to an orthonormal basis, branchlessly, after
+// Duff et al. (JCGT 2017).
+inline void orthonormalBasis(const glm::vec3 &n, glm::vec3 &tangent,
+                             glm::vec3 &bitangent) {
+  float sign = n.z >= 0.0f ? 1.0f : -1.0f;
+  float a = -1.0f / (sign + n.z);
+  float b = n.x * n.y * a;
+  tangent = {1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x};
+  bitangent = {b, sign + n.y * n.y * a, -n.y};
+}
+
+// Cosine-weighted direction around the unit normal n.
+inline glm::vec3 cosineHemisphere(const glm::vec3 &n, const glm::vec2 &u) {
+  float r = glm::sqrt(u.x);
+  float phi = glm::two_pi<float>() * u.y;
+  float x = r * glm::cos(phi);
+  float y = r * glm::sin(phi);
+  float z = glm::sqrt(glm::max(0.0f, 1.0f - u.x));
+
+  glm::vec3 tangent, bitangent;
+  orthonormalBasis(n, tangent, bitangent);
+  return x * tangent + y * bitangent + z * n;
+}
+
+// Uniform direction in the cone around the unit axis whose half-angle has
+// cosine cosMax; oneMinusCosMax is passed separately because 1 - cosMax
+// loses all precision for the narrow cones of small, distant lights.
+inline glm::vec3 uniformCone(const glm::vec3 &axis, float oneMinusCosMax,
+                             const glm::vec2 &u) {
+  float cosTheta = 1.0f - u.x * oneMinusCosMax;
+  float sinTheta = glm::sqrt(glm::max(0.0f, 1.0f - cosTheta * cosTheta));
+  float phi = glm::two_pi<float>() * u.y;
+
+  glm::vec3 tangent, bitangent;
+  orthonormalBasis(axis, tangent, bitangent);
+  return sinTheta * glm::cos(phi) * tangent +
+         sinTheta * glm::sin(phi) * bitangent + cosTheta * axis;
+}
+
+inline glm::vec3 randomUnitVec3OnSphere(Rng &rng) {
+  return uniformSphere(randomVec2(rng));
+}
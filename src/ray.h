@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// How a material scatters. Hot loops that handle one kind take it as a
+// template parameter so they compile without the material branch.
+enum class MaterialKind { Diffuse, Metallic };
+
+// albedo is the diffuse color, or the reflectance at normal incidence of a
+// metal. roughness only affects metals: it is the GGX alpha after squaring,
+// and 0 is a perfect mirror. Surfaces with nonzero emission are lights.
+struct Material {
+  glm::vec3 albedo;
+  float roughness;
+  float metallic;
+  glm::vec3 emission{0.0f};
+
+  MaterialKind kind() const {
+    return metallic != 0.0f ? MaterialKind::Metallic : MaterialKind::Diffuse;
+  }
+};
+
+// Spheres refer to their material by index into World::materials, so many
+// spheres can share one and the geometry stays compact.
+struct Sphere {
+  glm::vec3 center;
+  float radius;
+  uint32_t material;
+};
+
+struct Camera {
+  glm::vec3 position;
+};
+
+struct HitRecord {
+  Sphere *sphere;
+  float t;
+};
+
+// direction is always unit length, which keeps the quadratic in every
+// sphere test monic: no a = dot(direction, direction) and no division.
+struct Ray {
+  glm::vec3 origin;
+  glm::vec3 direction;
+
+  glm::vec3 at(float t) const { return origin + t * direction; }
+
+  float intersects(const Sphere &sphere, float minT, float maxT) const {
+    glm::vec3 oc = sphere.center - origin;
+    float h = glm::dot(direction, oc);
+    float c = glm::dot(oc, oc) - (sphere.radius * sphere.radius);
+    float d = h * h - c;
+
+    if (d < 0) {
+      return -1.0f;
+    }
+
+    d = glm::sqrt(d);
+
+    float t = h - d;
+
+    if (t <= minT || t >= maxT) {
+      t = h + d;
+      if (t <= minT || t >= maxT) {
+        return -1.0f;
+      }
+    }
+
+    return t;
+  }
+};
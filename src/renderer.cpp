@@ -0,0 +1,421 @@
+#include "renderer.h"
+
+#include <algorithm>
+#include <functional>
+
+#include "profile.h"
+
+
+// The image plane sits one unit down -z from the camera and spans
+// [-aspect, aspect] x [-1, 1], scaled by the tangent of half the field of
+// view. It moves with the camera, so the directions don't depend on where
+// the camera is.
+CameraRays cameraRays(uint32_t width, uint32_t height, float fov) {
+  float halfHeight = glm::tan(glm::radians(fov / 2.0f));
+  float halfWidth = static_cast<float>(width) / height * halfHeight;
+
+  return {glm::vec3{-halfWidth, halfHeight, -1.0f},
+          glm::vec3{2.0f * halfWidth / width, 0.0f, 0.0f},
+          glm::vec3{0.0f, -2.0f * halfHeight / height, 0.0f}};
+}
+
+Renderer::Renderer(World &world, const RenderSettings &settings)
+    : settings{settings}, world{world}, scheduler{settings.threadCount},
+      wavefronts(settings.wavefront ? scheduler.threadCount() : 0),
+      accumulation(settings.width * settings.height, glm::vec3{0.0f}),
+      lumaSquares(settings.width * settings.height, 0.0f),
+      sampleCounts(settings.width * settings.height, 0),
+      converged(settings.width * settings.height, 0),
+      firstHitSums(settings.denoise ? settings.width * settings.height : 0,
+                   FirstHit{glm::vec3{0.0f}, glm::vec3{0.0f}}),
+      activeCount{settings.width * settings.height} {
+  excludeOutsideRegion();
+}
+
+void Renderer::renderPass() {
+  PROFILE_SCOPE(Pass);
+
+  primaryRays = cameraRays(settings.width, settings.height, settings.fov);
+
+  if (chunkedScene != nullptr) {
+    renderPassStreaming();
+    if (!cancelled) {
+      passCount++;
+    }
+    return;
+  }
+
+  scheduler.run(settings.width, settings.height, settings.tileSize,
+                [&](const Tile &tile, uint32_t worker) {
+                  if (cancelled) {
+                    return;
+                  }
+
+                  PROFILE_SCOPE(Tile);
+
+                  if (settings.wavefront) {
+                    renderTileWavefront(tile, wavefronts[worker]);
+                  } else {
+                    renderTile(tile);
+                  }
+                });
+
+  if (!cancelled) {
+    passCount++;
+  }
+}
+
+void Renderer::reset() {
+  std::fill(accumulation.begin(), accumulation.end(), glm::vec3{0.0f});
+  std::fill(lumaSquares.begin(), lumaSquares.end(), 0.0f);
+  std::fill(sampleCounts.begin(), sampleCounts.end(), 0);
+  std::fill(converged.begin(), converged.end(), 0);
+  std::fill(firstHitSums.begin(), firstHitSums.end(),
+            FirstHit{glm::vec3{0.0f}, glm::vec3{0.0f}});
+
+  passCount = 0;
+  activeCount = settings.width * settings.height;
+  sampleTotal = 0;
+  rayTotal = 0;
+  cancelled = false;
+
+  excludeOutsideRegion();
+}
+
+Tile Renderer::region() const {
+  const Tile &r = settings.region;
+  if (r.x1 <= r.x0 || r.y1 <= r.y0) {
+    return {0, 0, settings.width, settings.height};
+  }
+  uint32_t x1 = std::min(r.x1, settings.width);
+  uint32_t y1 = std::min(r.y1, settings.height);
+  return {std::min(r.x0, x1), std::min(r.y0, y1), x1, y1};
+}
+
+// Pixels outside the region start out converged, so passes skip them.
+void Renderer::excludeOutsideRegion() {
+  Tile r = region();
+  uint32_t inside = 0;
+
+  for (uint32_t y = 0; y < settings.height; y++) {
+    for (uint32_t x = 0; x < settings.width; x++) {
+      bool covered = x >= r.x0 && x < r.x1 && y >= r.y0 && y < r.y1;
+      converged[y * settings.width + x] = !covered;
+      inside += covered;
+    }
+  }
+
+  activeCount = inside;
+}
+
+void Renderer::addPixelSums(uint32_t idx, const PixelSums &sums) {
+  accumulation[idx] += sums.color;
+  lumaSquares[idx] += sums.lumaSquares;
+  sampleCounts[idx] += sums.samples;
+  sampleTotal += sums.samples;
+}
+
+void Renderer::addGuideSums(uint32_t idx, const FirstHit &sums) {
+  firstHitSums[idx].albedo += sums.albedo;
+  firstHitSums[idx].normal += sums.normal;
+}
+
+// The test only depends on the sums, so it gives the same answer it gave
+// when the sums were recorded.
+void Renderer::restorePasses(uint32_t passes) {
+  Tile r = region();
+  uint32_t active = 0;
+
+  for (uint32_t y = r.y0; y < r.y1; y++) {
+    for (uint32_t x = r.x0; x < r.x1; x++) {
+      uint32_t idx = y * settings.width + x;
+      converged[idx] = hasConverged(idx);
+      active += !converged[idx];
+    }
+  }
+
+  passCount = passes;
+  activeCount = active;
+}
+
+void Renderer::resize(uint32_t width, uint32_t height) {
+  settings.width = width;
+  settings.height = height;
+  settings.region = {};
+
+  accumulation.resize(width * height);
+  lumaSquares.resize(width * height);
+  sampleCounts.resize(width * height);
+  converged.resize(width * height);
+  firstHitSums.resize(settings.denoise ? width * height : 0);
+
+  reset();
+}
+
+void Renderer::renderTile(const Tile &tile) {
+  uint32_t span = settings.packetTracing ? packetSize : 1;
+  uint64_t tileSamples = 0;
+  uint64_t raysBefore = raysTraced;
+
+  for (uint32_t y = tile.y0; y < tile.y1; y++) {
+    // Packets are built from the next span unconverged pixels of the row.
+    for (uint32_t x = tile.x0; x < tile.x1;) {
+      RayPacket packet;
+      Sampler samplers[packetSize];
+      uint32_t indices[packetSize];
+
+      for (; x < tile.x1 && packet.count < span; x++) {
+        uint32_t idx = y * settings.width + x;
+        if (converged[idx]) {
+          continue;
+        }
+
+        uint32_t lane = packet.count++;
+        indices[lane] = idx;
+        samplers[lane] = pixelSampler(settings.sampler, idx,
+                                      settings.firstSample + sampleCounts[idx]);
+        packet.set(lane, primaryRay(x, y, samplers[lane]));
+      }
+
+      if (packet.count == 0) {
+        continue;
+      }
+
+      tileSamples += packet.count;
+
+      FirstHit firstHits[packetSize];
+      FirstHit *aov = settings.denoise ? firstHits : nullptr;
+
+      if (packet.count == 1) {
+        accumulate(indices[0], world.color(packet.ray(0), settings.rayDepth,
+                                           samplers[0], aov));
+        if (aov != nullptr) {
+          accumulate(indices[0], firstHits[0]);
+        }
+        continue;
+      }
+
+      glm::vec3 colors[packetSize];
+      world.color(packet, settings.rayDepth, samplers, colors, aov);
+      for (uint32_t lane = 0; lane < packet.count; lane++) {
+        accumulate(indices[lane], colors[lane]);
+        if (aov != nullptr) {
+          accumulate(indices[lane], firstHits[lane]);
+        }
+      }
+    }
+  }
+
+  sampleTotal += tileSamples;
+  rayTotal += raysTraced - raysBefore;
+}
+
+void Renderer::renderTileWavefront(const Tile &tile, Wavefront &wavefront) {
+  uint64_t tileSamples = 0;
+  uint64_t raysBefore = raysTraced;
+
+  wavefront.begin((tile.x1 - tile.x0) * (tile.y1 - tile.y0));
+
+  for (uint32_t y = tile.y0; y < tile.y1; y++) {
+    for (uint32_t x = tile.x0; x < tile.x1; x++) {
+      uint32_t idx = y * settings.width + x;
+      if (converged[idx]) {
+        continue;
+      }
+
+      Sampler sampler = pixelSampler(settings.sampler, idx,
+                                     settings.firstSample + sampleCounts[idx]);
+      Ray ray = primaryRay(x, y, sampler);
+      wavefront.add(idx, ray, sampler, settings.rayDepth);
+      tileSamples++;
+    }
+  }
+
+  auto sink = [this](uint32_t idx, const glm::vec3 &color) {
+    accumulate(idx, color);
+  };
+  if (settings.denoise) {
+    wavefront.trace(world, sink, [this](uint32_t idx, const FirstHit &hit) {
+      accumulate(idx, hit);
+    });
+  } else {
+    wavefront.trace(world, sink);
+  }
+
+  sampleTotal += tileSamples;
+  rayTotal += raysTraced - raysBefore;
+}
+
+// The whole region is one stream of pixels, cut into batches; there are
+// no tiles, since every chunk queue collects rays from across the frame.
+void Renderer::renderPassStreaming() {
+  Tile r = region();
+
+  auto sink = [this](uint32_t idx, const glm::vec3 &color) {
+    accumulate(idx, color);
+  };
+  std::function<void(uint32_t, const FirstHit &)> firstHitSink;
+  if (settings.denoise) {
+    firstHitSink = [this](uint32_t idx, const FirstHit &hit) {
+      accumulate(idx, hit);
+    };
+  }
+
+  auto flush = [&] {
+    sampleTotal += streamer.size();
+    rayTotal += streamer.trace(world, *chunkedScene, scheduler, sink,
+                               firstHitSink);
+  };
+
+  streamer.begin(streamBatchSize);
+
+  for (uint32_t y = r.y0; y < r.y1 && !cancelled; y++) {
+    for (uint32_t x = r.x0; x < r.x1; x++) {
+      uint32_t idx = y * settings.width + x;
+      if (converged[idx]) {
+        continue;
+      }
+
+      Sampler sampler = pixelSampler(settings.sampler, idx,
+                                     settings.firstSample + sampleCounts[idx]);
+      streamer.add(idx, primaryRay(x, y, sampler), sampler, settings.rayDepth);
+
+      if (streamer.size() == streamBatchSize) {
+        flush();
+        streamer.begin(streamBatchSize);
+      }
+    }
+  }
+
+  if (!cancelled && streamer.size() > 0) {
+    flush();
+  }
+}
+
+Ray Renderer::primaryRay(uint32_t x, uint32_t y, Sampler &sampler) const {
+  PROFILE_SCOPE(RayGen);
+
+  glm::vec2 offset = sampler.next2D();
+  float px = static_cast<float>(x) + offset.x;
+  float py = static_cast<float>(y) + offset.y;
+
+  Ray ray{};
+  ray.origin = world.camera.position;
+  ray.direction = glm::normalize(primaryRays.corner + px * primaryRays.deltaX +
+                                 py * primaryRays.deltaY);
+  return ray;
+}
+
+void Renderer::accumulate(uint32_t idx, const glm::vec3 &color) {
+  float luma = glm::dot(color, glm::vec3{0.2126f, 0.7152f, 0.0722f});
+
+  accumulation[idx] += color;
+  lumaSquares[idx] += luma * luma;
+  ++sampleCounts[idx];
+
+  if (hasConverged(idx)) {
+    converged[idx] = 1;
+    activeCount--;
+  }
+}
+
+bool Renderer::hasConverged(uint32_t idx) const {
+  uint32_t n = sampleCounts[idx];
+  if (settings.adaptiveThreshold <= 0.0f || n < settings.minSamples) {
+    return false;
+  }
+
+  float mean =
+      glm::dot(accumulation[idx], glm::vec3{0.2126f, 0.7152f, 0.0722f}) / n;
+  float variance = glm::max(0.0f, lumaSquares[idx] / n - mean * mean);
+  float error = glm::sqrt(variance / n);
+
+  return error <= settings.adaptiveThreshold * glm::max(mean, 1e-3f);
+}
+
+// Only called when settings.denoise is set, and only for the first hit of
+// a sample, so the sums stay in step with sampleCounts.
+void Renderer::accumulate(uint32_t idx, const FirstHit &firstHit) {
+  firstHitSums[idx].albedo += firstHit.albedo;
+  firstHitSums[idx].normal += firstHit.normal;
+}
+
+glm::vec3 Renderer::average(uint32_t idx) const {
+  float scale = 1.0f / glm::max(1u, sampleCounts[idx]);
+  return accumulation[idx] * scale;
+}
+
+// Loads the averages and guides into the denoiser and filters them; the
+// result is left in denoiser.samples.
+void Renderer::runDenoiser() {
+  uint32_t width = settings.width;
+  denoiser.resize(width, settings.height);
+
+  scheduler.run(width, settings.height, settings.tileSize,
+                [&](const Tile &tile, uint32_t) {
+                  for (uint32_t y = tile.y0; y < tile.y1; y++) {
+                    for (uint32_t x = tile.x0; x < tile.x1; x++) {
+                      uint32_t idx = y * width + x;
+                      uint32_t n = sampleCounts[idx];
+                      float scale = 1.0f / glm::max(1u, n);
+
+                      glm::vec3 mean = average(idx);
+                      float luma = glm::dot(
+                          mean, glm::vec3{0.2126f, 0.7152f, 0.0722f});
+                      float variance = glm::max(
+                          0.0f, lumaSquares[idx] * scale - luma * luma);
+
+                      glm::vec3 normal = firstHitSums[idx].normal;
+                      float length = glm::length(normal);
+
+                      denoiser.samples[idx] = {mean, variance * scale};
+                      denoiser.guides[idx] = {
+                          firstHitSums[idx].albedo * scale,
+                          length > 0.0f ? normal / length : normal};
+                    }
+                  }
+                });
+
+  denoiser.run(scheduler);
+}
+
+void Renderer::resolve(uint32_t *pixels) {
+  PROFILE_SCOPE(Resolve);
+
+  bool denoise = settings.denoise && !firstHitSums.empty();
+  if (denoise) {
+    runDenoiser();
+  }
+
+  resolved.resize(settings.width * settings.height);
+
+  // Each tile row is averaged and then tone mapped as one span.
+  scheduler.run(settings.width, settings.height, settings.tileSize,
+                [&](const Tile &tile, uint32_t) {
+                  for (uint32_t y = tile.y0; y < tile.y1; y++) {
+                    uint32_t row = y * settings.width;
+                    for (uint32_t x = tile.x0; x < tile.x1; x++) {
+                      uint32_t idx = row + x;
+                      resolved[idx] = denoise ? denoiser.samples[idx].color
+                                              : average(idx);
+                    }
+                    toneMap(&resolved[row + tile.x0], &pixels[row + tile.x0],
+                            tile.x1 - tile.x0, settings.toneMap);
+                  }
+                });
+}
+
+void Renderer::resolveLinear(float *rgb) {
+  bool denoise = settings.denoise && !firstHitSums.empty();
+  if (denoise) {
+    runDenoiser();
+  }
+
+  for (size_t idx = 0; idx < accumulation.size(); idx++) {
+    glm::vec3 pixelColor = denoise ? denoiser.samples[idx].color
+                                   : average(static_cast<uint32_t>(idx));
+    rgb[idx * 3 + 0] = pixelColor.r;
+    rgb[idx * 3 + 1] = pixelColor.g;
+    rgb[idx * 3 + 2] = pixelColor.b;
+  }
+}
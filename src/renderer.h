@@ -0,0 +1,184 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "denoise.h"
+#include "scheduler.h"
+#include "streaming.h"
+#include "tonemap.h"
+#include "wavefront.h"
+#include "world.h"
+
+struct RenderSettings {
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t sampleCount = 150;
+  // Adaptive sampling: after minSamples a pixel stops once the standard
+  // error of its mean luminance falls below adaptiveThreshold times the
+  // mean. A threshold of 0 always takes sampleCount samples.
+  uint32_t minSamples = 16;
+  float adaptiveThreshold = 0.01f;
+  float rayDepth = 50.0f;
+  float fov = 60.0f;
+  uint32_t tileSize = 32;
+  // Trace primary rays in packets of packetSize horizontally adjacent pixels.
+  bool packetTracing = true;
+  // Trace each tile breadth-first, one bounce of every path at a time, with
+  // hits grouped by material before shading. Takes precedence over
+  // packetTracing.
+  bool wavefront = false;
+  // 0 picks one worker per hardware thread.
+  uint32_t threadCount = 0;
+  // For splitting a frame across machines: only pixels inside region are
+  // rendered (an empty region is the whole frame), and sample indices
+  // start at firstSample so every machine draws different samples.
+  Tile region{};
+  uint32_t firstSample = 0;
+  // Written to partial files so samples of different scenes are never
+  // mixed; see sceneFingerprint().
+  uint64_t sceneId = 0;
+  // Record first-hit albedo and normals and run Denoiser over the averages
+  // on every resolve, before gamma. Meant for low sample counts. Partial
+  // files carry the guides for resuming, but merged renders aren't
+  // denoised.
+  bool denoise = false;
+  // Sobol converges faster per sample; Random is plain PCG32.
+  SamplerKind sampler = SamplerKind::Sobol;
+  // Display transform used by resolve(). May be changed between resolves
+  // without resetting; the accumulated radiance is kept as is.
+  ToneMapSettings toneMap{};
+};
+
+// Raw per-pixel sums, for moving partial renders between machines.
+struct PixelSums {
+  glm::vec3 color;
+  float lumaSquares;
+  uint32_t samples;
+};
+
+// Unnormalized direction from the camera through the top-left corner of
+// the image and its step per pixel; pixel (x, y) is sampled along
+// corner + x * deltaX + y * deltaY. Shared by every backend.
+struct CameraRays {
+  glm::vec3 corner;
+  glm::vec3 deltaX;
+  glm::vec3 deltaY;
+};
+
+CameraRays cameraRays(uint32_t width, uint32_t height, float fov);
+
+// Progressive renderer: every pass adds one sample to each unconverged pixel
+// of a float accumulation buffer, which resolve() tone-maps for display at
+// any time.
+class Renderer {
+public:
+  Renderer(World &world, const RenderSettings &settings);
+
+  // Renders one more sample for every pixel that hasn't converged. A pass
+  // interrupted by cancel() is not counted.
+  void renderPass();
+
+  // Makes the pass in flight return as soon as its current tiles finish.
+  void cancel() { cancelled = true; }
+  bool isCancelled() const { return cancelled; }
+
+  // Throws away every sample so far, e.g. after the camera or scene
+  // changed, and clears a pending cancel(). Keeps all buffers allocated.
+  // Must not overlap a renderPass().
+  void reset();
+
+  // Changes the output size and resets. Buffers are only reallocated when
+  // the new size is larger than any so far, so shrinking and growing back is
+  // free. Must not overlap a renderPass() or a resolve().
+  void resize(uint32_t width, uint32_t height);
+
+  uint32_t passes() const { return passCount; }
+  uint64_t samples() const { return sampleTotal; }
+  uint64_t rays() const { return rayTotal; }
+  uint32_t activePixels() const { return activeCount; }
+
+  bool done() const {
+    return passCount >= settings.sampleCount || activeCount == 0;
+  }
+
+  // The part of the frame this renderer covers.
+  Tile region() const;
+
+  PixelSums pixelSums(uint32_t idx) const {
+    return {accumulation[idx], lumaSquares[idx], sampleCounts[idx]};
+  }
+
+  // Adds samples rendered elsewhere for the same pixel. Must not overlap a
+  // renderPass().
+  void addPixelSums(uint32_t idx, const PixelSums &sums);
+
+  // Summed first-hit guides, kept only when settings.denoise is set.
+  bool hasGuides() const { return !firstHitSums.empty(); }
+  FirstHit guideSums(uint32_t idx) const { return firstHitSums[idx]; }
+
+  // Like addPixelSums(), for the guides. Needs hasGuides().
+  void addGuideSums(uint32_t idx, const FirstHit &sums);
+
+  // For resuming from sums loaded with addPixelSums(): sets the pass count
+  // and redoes the adaptive convergence test of every pixel in the region.
+  void restorePasses(uint32_t passes);
+
+  // Averages the accumulated samples, denoises them if enabled and tone
+  // maps them to RGBA8888 with settings.toneMap, spread over the worker
+  // threads. Must not overlap a renderPass().
+  void resolve(uint32_t *pixels);
+
+  // Averaged, and if enabled denoised, linear radiance as packed RGB
+  // floats, for HDR output.
+  void resolveLinear(float *rgb);
+
+  // Out-of-core rendering: when set, passes trace against scene instead of
+  // the world's spheres, in batches of streamBatchSize paths with rays
+  // queued per chunk. The world still supplies the camera and materials.
+  // A cancel() takes effect between batches. Null goes back to the world.
+  void setChunkedScene(ChunkedScene *scene) { chunkedScene = scene; }
+
+  // Read-only outside the renderer; resize() changes width and height.
+  RenderSettings settings;
+
+private:
+  Ray primaryRay(uint32_t x, uint32_t y, Sampler &sampler) const;
+  void renderTile(const Tile &tile);
+  void renderTileWavefront(const Tile &tile, Wavefront &wavefront);
+  void renderPassStreaming();
+  void accumulate(uint32_t idx, const glm::vec3 &color);
+  bool hasConverged(uint32_t idx) const;
+  void accumulate(uint32_t idx, const FirstHit &firstHit);
+  glm::vec3 average(uint32_t idx) const;
+  void runDenoiser();
+  void excludeOutsideRegion();
+
+  World &world;
+  TileScheduler scheduler;
+  std::vector<Wavefront> wavefronts;
+  ChunkedScene *chunkedScene = nullptr;
+  StreamTracer streamer;
+
+  // Refreshed at the start of every pass, after any camera edit.
+  CameraRays primaryRays{};
+
+  std::vector<glm::vec3> accumulation;
+  std::vector<float> lumaSquares;
+  std::vector<uint32_t> sampleCounts;
+  std::vector<uint8_t> converged;
+  // Summed first-hit features; empty unless settings.denoise.
+  std::vector<FirstHit> firstHitSums;
+
+  Denoiser denoiser;
+  // Linear input of the tone-map pass, reused between resolves.
+  std::vector<glm::vec3> resolved;
+
+  std::atomic<uint32_t> passCount{0};
+  std::atomic<uint32_t> activeCount;
+  std::atomic<uint64_t> sampleTotal{0};
+  std::atomic<uint64_t> rayTotal{0};
+  std::atomic<bool> cancelled{false};
+};
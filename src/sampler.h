@@ -0,0 +1,145 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "profile.h"
+#include "random.h"
+
+// Where the random numbers of a path come from.
+enum class SamplerKind {
+  // Independent PCG32 draws.
+  Random,
+  // Owen-scrambled Sobol points (Burley, "Practical Hash-based Owen
+  // Scrambling", JCGT 2020). Every pair of dimensions is a scrambled 2D
+  // Sobol sequence with its own index shuffle, so a pixel's first N samples
+  // are stratified in each pair for any N and pixels stay decorrelated.
+  Sobol,
+};
+
+inline uint32_t reverseBits(uint32_t v) {
+  v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+  v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+  v = ((v >> 4) & 0x0F0F0F0Fu) | ((v & 0x0F0F0F0Fu) << 4);
+  v = ((v >> 8) & 0x00FF00FFu) | ((v & 0x00FF00FFu) << 8);
+  return (v >> 16) | (v << 16);
+}
+
+inline uint32_t hashUint(uint32_t v) {
+  uint32_t state = v * 747796405u + 2891336453u;
+  uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+  return (word >> 22u) ^ word;
+}
+
+inline uint32_t hashCombine(uint32_t seed, uint32_t v) {
+  return seed ^ (hashUint(v) + 0x9E3779B9u + (seed << 6) + (seed >> 2));
+}
+
+// Flips every bit depending only on the bits below it, which on the
+// reversed value is a nested uniform (Owen) scramble.
+inline uint32_t laineKarrasPermutation(uint32_t v, uint32_t seed) {
+  v += seed;
+  v ^= v * 0x6C50B47Cu;
+  v ^= v * 0xB82F1E52u;
+  v ^= v * 0xC7AFE638u;
+  v ^= v * 0x8D22F6E6u;
+  return v;
+}
+
+// Sobol points are generated bit-reversed, where the Owen scramble is a
+// single permutation and dimension 0 of index i is i itself. Dimension 1
+// has reversed direction numbers r_j = r_(j-1) ^ (r_(j-1) << 1), applied a
+// byte at a time from this table.
+inline constexpr std::array<uint32_t, 4 * 256> sobolDimension1Table = [] {
+  uint32_t directions[32] = {};
+  uint32_t r = 1;
+  for (uint32_t j = 0; j < 32; j++) {
+    directions[j] = r;
+    r ^= r << 1;
+  }
+
+  std::array<uint32_t, 4 * 256> table{};
+  for (uint32_t k = 0; k < 4; k++) {
+    for (uint32_t byte = 0; byte < 256; byte++) {
+      uint32_t sum = 0;
+      for (uint32_t j = 0; j < 8; j++) {
+        if (byte >> j & 1) {
+          sum ^= directions[8 * k + j];
+        }
+      }
+      table[k * 256 + byte] = sum;
+    }
+  }
+  return table;
+}();
+
+inline uint32_t sobolDimension1Reversed(uint32_t index) {
+  return sobolDimension1Table[index & 0xFF] ^
+         sobolDimension1Table[256 + (index >> 8 & 0xFF)] ^
+         sobolDimension1Table[512 + (index >> 16 & 0xFF)] ^
+         sobolDimension1Table[768 + (index >> 24)];
+}
+
+// Top 24 bits of the un-reversed value, scaled into [0, 1).
+inline float reversedToFloat(uint32_t reversed) {
+  return static_cast<float>(reverseBits(reversed) >> 8) * 0x1p-24f;
+}
+
+// The random number source of one path. Each call takes the next
+// dimension, so the pixel jitter, every bounce's direction and every
+// roulette test read their own dimensions of the sequence.
+struct Sampler {
+  Rng rng;
+  uint32_t seed = 0;
+  uint32_t index = 0;
+  uint32_t dimension = 0;
+  SamplerKind kind = SamplerKind::Random;
+
+  float next1D() {
+    if (kind == SamplerKind::Random) {
+      return randomFloat(rng);
+    }
+
+    PROFILE_COUNT(RngDraws, 1);
+    uint32_t dimSeed = hashCombine(seed, dimension++);
+    uint32_t shuffled = shuffledIndex(dimSeed);
+    return reversedToFloat(
+        laineKarrasPermutation(shuffled, dimSeed * 0x9E3779B9u));
+  }
+
+  glm::vec2 next2D() {
+    if (kind == SamplerKind::Random) {
+      return randomVec2(rng);
+    }
+
+    PROFILE_COUNT(RngDraws, 2);
+    uint32_t dimSeed = hashCombine(seed, dimension++);
+    uint32_t shuffled = shuffledIndex(dimSeed);
+    return {reversedToFloat(
+                laineKarrasPermutation(shuffled, dimSeed * 0x9E3779B9u)),
+            reversedToFloat(laineKarrasPermutation(
+                sobolDimension1Reversed(shuffled), dimSeed * 0x85EBCA6Bu))};
+  }
+
+private:
+  // Owen-scrambles the sample index itself, which gives every dimension
+  // pair its own ordering of the points.
+  uint32_t shuffledIndex(uint32_t dimSeed) const {
+    return reverseBits(laineKarrasPermutation(reverseBits(index), dimSeed));
+  }
+};
+
+// Like pixelRng(), the result depends only on the pixel and sample index.
+inline Sampler pixelSampler(SamplerKind kind, uint32_t pixel,
+                            uint32_t sample) {
+  Sampler sampler;
+  sampler.kind = kind;
+  if (kind == SamplerKind::Random) {
+    sampler.rng = pixelRng(pixel, sample);
+  } else {
+    sampler.seed = hashUint(pixel);
+    sampler.index = sample;
+  }
+  return sampler;
+}
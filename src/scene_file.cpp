@@ -0,0 +1,175 @@
+#include "scene_file.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fmt/core.h>
+#include <type_traits>
+
+#include "mapped_file.h"
+
+static_assert(std::is_trivially_copyable_v<Sphere>);
+static_assert(std::is_trivially_copyable_v<Material>);
+static_assert(sizeof(Sphere) == 20);
+static_assert(sizeof(Material) == 32);
+static_assert(std::is_trivially_copyable_v<BvhNode>);
+static_assert(sizeof(BvhNode) == 32);
+
+namespace {
+
+constexpr uint64_t sectionAlignment = 64;
+
+uint64_t alignUp(uint64_t offset) {
+  return (offset + sectionAlignment - 1) & ~(sectionAlignment - 1);
+}
+
+bool writeSection(std::FILE *file, uint64_t offset, const void *data,
+                  size_t size) {
+  static const uint8_t zeros[sectionAlignment] = {};
+
+  long position = std::ftell(file);
+  if (position < 0 || static_cast<uint64_t>(position) > offset) {
+    return false;
+  }
+
+  size_t padding = static_cast<size_t>(offset - position);
+  return std::fwrite(zeros, 1, padding, file) == padding &&
+         std::fwrite(data, 1, size, file) == size;
+}
+
+bool sectionFits(const MappedFile &file, uint64_t offset, uint64_t size) {
+  return offset % sectionAlignment == 0 && offset <= file.size() &&
+         size <= file.size() - offset;
+}
+
+} // namespace
+
+bool saveScene(const std::string &path, const World &world, bool includeBvh) {
+  const Bvh &bvh = world.bvh;
+  bool withBvh = includeBvh && !bvh.nodes.empty() &&
+                 bvh.primitives.size() == world.spheres.size();
+
+  SceneFileHeader header{};
+  std::memcpy(header.magic, sceneFileMagic, sizeof(header.magic));
+  header.version = sceneFileVersion;
+  header.sphereCount = static_cast<uint32_t>(world.spheres.size());
+  header.materialCount = static_cast<uint32_t>(world.materials.size());
+  header.nodeCount = withBvh ? static_cast<uint32_t>(bvh.nodes.size()) : 0;
+  header.cameraPosition = world.camera.position;
+
+  uint64_t spheresSize = world.spheres.size() * sizeof(Sphere);
+  uint64_t materialsSize = world.materials.size() * sizeof(Material);
+  uint64_t nodesSize = header.nodeCount * sizeof(BvhNode);
+  uint64_t primitivesSize = withBvh ? bvh.primitives.size() * sizeof(uint32_t) : 0;
+
+  header.spheresOffset = alignUp(sizeof(SceneFileHeader));
+  header.materialsOffset = alignUp(header.spheresOffset + spheresSize);
+  header.nodesOffset = alignUp(header.materialsOffset + materialsSize);
+  header.primitivesOffset = alignUp(header.nodesOffset + nodesSize);
+
+  std::FILE *file = std::fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    fmt::println("Failed to open {} for writing", path);
+    return false;
+  }
+
+  bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+            writeSection(file, header.spheresOffset, world.spheres.data(),
+                         spheresSize) &&
+            writeSection(file, header.materialsOffset, world.materials.data(),
+                         materialsSize);
+  if (ok && withBvh) {
+    ok = writeSection(file, header.nodesOffset, bvh.nodes.data(), nodesSize) &&
+         writeSection(file, header.primitivesOffset, bvh.primitives.data(),
+                      primitivesSize);
+  }
+
+  ok = std::fclose(file) == 0 && ok;
+  if (!ok) {
+    fmt::println("Failed to write {}", path);
+  }
+  return ok;
+}
+
+bool loadScene(const std::string &path, World &world) {
+  MappedFile file;
+  if (!file.open(path)) {
+    fmt::println("Failed to map {}", path);
+    return false;
+  }
+
+  SceneFileHeader header;
+  if (file.size() < sizeof(header)) {
+    fmt::println("{} is not a scene file", path);
+    return false;
+  }
+  std::memcpy(&header, file.data(), sizeof(header));
+
+  if (std::memcmp(header.magic, sceneFileMagic, sizeof(header.magic)) != 0) {
+    fmt::println("{} is not a scene file", path);
+    return false;
+  }
+
+  if (header.version != sceneFileVersion) {
+    fmt::println("{} has version {}, expected {}", path, header.version,
+                 sceneFileVersion);
+    return false;
+  }
+
+  uint64_t spheresSize = uint64_t{header.sphereCount} * sizeof(Sphere);
+  uint64_t materialsSize = uint64_t{header.materialCount} * sizeof(Material);
+  uint64_t nodesSize = uint64_t{header.nodeCount} * sizeof(BvhNode);
+  uint64_t primitivesSize = uint64_t{header.sphereCount} * sizeof(uint32_t);
+
+  bool valid = sectionFits(file, header.spheresOffset, spheresSize) &&
+               sectionFits(file, header.materialsOffset, materialsSize);
+  if (header.nodeCount > 0) {
+    valid = valid && sectionFits(file, header.nodesOffset, nodesSize) &&
+            sectionFits(file, header.primitivesOffset, primitivesSize);
+  }
+  if (!valid) {
+    fmt::println("{} is truncated or corrupt", path);
+    return false;
+  }
+
+  const Sphere *spheres =
+      reinterpret_cast<const Sphere *>(file.data() + header.spheresOffset);
+
+  const Material *materials =
+      reinterpret_cast<const Material *>(file.data() + header.materialsOffset);
+
+  for (uint32_t i = 0; i < header.sphereCount; i++) {
+    if (spheres[i].material >= header.materialCount) {
+      fmt::println("{} has a sphere with an invalid material", path);
+      return false;
+    }
+  }
+
+  world.camera.position = header.cameraPosition;
+  world.spheres.assign(spheres, spheres + header.sphereCount);
+  world.materials.assign(materials, materials + header.materialCount);
+
+  if (header.nodeCount == 0) {
+    world.build();
+    return true;
+  }
+
+  const BvhNode *nodes =
+      reinterpret_cast<const BvhNode *>(file.data() + header.nodesOffset);
+  const uint32_t *primitives =
+      reinterpret_cast<const uint32_t *>(file.data() + header.primitivesOffset);
+
+  Bvh &bvh = world.bvh;
+  bvh.nodes.assign(nodes, nodes + header.nodeCount);
+  bvh.primitives.assign(primitives, primitives + header.sphereCount);
+
+  // Checked once here so traversal never has to.
+  if (!bvh.valid(header.sphereCount)) {
+    fmt::println("{} has a corrupt BVH, rebuilding", path);
+    world.build();
+    return true;
+  }
+
+  bvh.leaves.assign(world.spheres, bvh.primitives);
+  world.findLights();
+  return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "world.h"
+
+// Binary scene format (.tts). A fixed header is followed by 64-byte aligned
+// sections laid out exactly like the in-memory arrays, so loading is a
+// bounds check and a copy per section rather than per-object parsing:
+//
+//   Sphere   spheres[sphereCount]
+//   Material materials[materialCount]
+//   BvhNode  nodes[nodeCount]          (optional, nodeCount may be 0)
+//   uint32   primitives[sphereCount]   (present with nodes)
+//
+// All values are little-endian.
+constexpr char sceneFileMagic[8] = {'T', 'T', 'S', 'C', 'E', 'N', 'E', '\0'};
+constexpr uint32_t sceneFileVersion = 3;
+
+struct SceneFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t sphereCount;
+  uint32_t materialCount;
+  uint32_t nodeCount;
+  glm::vec3 cameraPosition;
+  float padding;
+  uint64_t spheresOffset;
+  uint64_t materialsOffset;
+  uint64_t nodesOffset;
+  uint64_t primitivesOffset;
+};
+
+// Writes world, including its BVH when it has been built and includeBvh is
+// set.
+bool saveScene(const std::string &path, const World &world,
+               bool includeBvh = true);
+
+// Replaces world with the scene in path. If the file carries a BVH it is
+// used as is, otherwise one is built.
+bool loadScene(const std::string &path, World &world);
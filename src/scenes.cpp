@@ -0,0 +1,219 @@
+#include "scenes.h"
+
+#include <cmath>
+#include <vector>
+
+World defaultScene() {
+  return World{.camera = {.position = glm::vec3{0.0f}},
+               .spheres = {{.center = glm::vec3{0.0f, 0.0f, -1.0},
+                            .radius = 0.2f,
+                            .material = 0},
+                           {.center = glm::vec3{0.45f, 0.0f, -1.0},
+                            .radius = 0.2f,
+                            .material = 1},
+                           {.center = glm::vec3{0.0f, -100.21f, -1.0},
+                            .radius = 100.0f,
+                            .material = 2},
+                           {.center = glm::vec3{-0.6f, 0.9f, -0.4f},
+                            .radius = 0.25f,
+                            .material = 3}},
+               .materials = {{.albedo = glm::vec3{0.5, 0.5, 0.5},
+                              .roughness = 1.0f,
+                              .metallic = 0.0f},
+                             {.albedo = glm::vec3{1.0, 1.0, 1.0},
+                              .roughness = 0.2f,
+                              .metallic = 1.0f},
+                             {.albedo = glm::vec3{0.4, 0.8, 0.5},
+                              .roughness = 1.0f,
+                              .metallic = 0.0f},
+                             {.albedo = glm::vec3{1.0, 1.0, 1.0},
+                              .roughness = 1.0f,
+                              .metallic = 0.0f,
+                              .emission = glm::vec3{8.0f, 7.0f, 6.0f}}}};
+}
+
+namespace {
+
+constexpr float side = 2.0f;
+constexpr uint32_t paletteSize = 32;
+
+// Centre of the box the spheres go in.
+const glm::vec3 boxCenter{0.0f, 0.0f, -side / 2 - 1.5f};
+
+// The ground, a light above the box and the shared palette. Material 0 is
+// the ground and the last one the light; the spheres pick from the rest.
+// Palette metals cycle through a few roughnesses.
+World groundAndPalette(Rng &rng, uint32_t count) {
+  World world{.camera = {.position = glm::vec3{0.0f}}, .spheres = {}};
+  world.spheres.reserve(count + 2);
+
+  world.materials.push_back(
+      {.albedo = glm::vec3{0.5, 0.5, 0.5}, .roughness = 1.0f, .metallic = 0.0f});
+  for (uint32_t i = 0; i < paletteSize; i++) {
+    glm::vec3 albedo = randomVec3(rng, 0.2f, 1.0f);
+    float metallic = randomFloat(rng) < 0.2f ? 1.0f : 0.0f;
+    float roughness = metallic != 0.0f ? 0.1f * (i % 4) : 1.0f;
+    world.materials.push_back(
+        {.albedo = albedo, .roughness = roughness, .metallic = metallic});
+  }
+  world.materials.push_back({.albedo = glm::vec3{1.0f},
+                             .roughness = 1.0f,
+                             .metallic = 0.0f,
+                             .emission = glm::vec3{6.0f}});
+
+  world.spheres.push_back({.center = glm::vec3{0.0f, -101.0f, -3.0f},
+                           .radius = 100.0f,
+                           .material = 0});
+  world.spheres.push_back({.center = boxCenter + glm::vec3{-1.0f, 2.5f, 1.0f},
+                           .radius = 0.5f,
+                           .material = paletteSize + 1});
+  return world;
+}
+
+uint32_t randomMaterial(Rng &rng) { return 1 + rng.next() % paletteSize; }
+
+// Spacing that keeps the fraction of the box the spheres fill constant as
+// count grows.
+float spacingFor(uint32_t count) {
+  return side / std::cbrt(static_cast<float>(glm::max(count, 1u)));
+}
+
+void addGrid(World &world, Rng &rng, uint32_t count) {
+  uint32_t perSide = static_cast<uint32_t>(
+      std::ceil(std::cbrt(static_cast<float>(glm::max(count, 1u)))));
+  float spacing = side / perSide;
+  glm::vec3 origin = boxCenter - glm::vec3{side / 2 - spacing / 2};
+
+  for (uint32_t i = 0; i < count; i++) {
+    glm::vec3 cell{static_cast<float>(i % perSide),
+                   static_cast<float>(i / perSide % perSide),
+                   static_cast<float>(i / (perSide * perSide))};
+    world.spheres.push_back({.center = origin + cell * spacing,
+                             .radius = 0.35f * spacing,
+                             .material = randomMaterial(rng)});
+  }
+}
+
+// Roughly 1000 spheres per cluster, each cluster a ball a tenth of the box
+// wide, so most of the box is empty.
+void addClusters(World &world, Rng &rng, uint32_t count) {
+  uint32_t clusterCount = glm::max(1u, count / 1000);
+  float clusterRadius = 0.1f * side;
+  // Same fill fraction inside a cluster as randomScene() has in the box.
+  uint32_t perCluster = (count + clusterCount - 1) / clusterCount;
+  float spacing = clusterRadius * std::cbrt(4.0f / glm::max(perCluster, 1u));
+
+  std::vector<glm::vec3> centers(clusterCount);
+  for (glm::vec3 &center : centers) {
+    center = boxCenter + randomVec3(rng, -side / 2 + clusterRadius,
+                                    side / 2 - clusterRadius);
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    glm::vec3 offset = uniformSphere(randomVec2(rng)) * clusterRadius *
+                       std::cbrt(randomFloat(rng));
+    world.spheres.push_back(
+        {.center = centers[i % clusterCount] + offset,
+         .radius = randomFloat(rng, 0.1f, 0.4f) * spacing,
+         .material = randomMaterial(rng)});
+  }
+}
+
+// Nests of up to 64 concentric spheres, each slightly smaller than the
+// last and nudged off centre so the boxes don't coincide exactly.
+void addNested(World &world, Rng &rng, uint32_t count) {
+  constexpr uint32_t depth = 64;
+  uint32_t nestCount = (count + depth - 1) / depth;
+  float nestRadius = 0.45f * spacingFor(nestCount);
+
+  glm::vec3 center{0.0f};
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t level = i % depth;
+    if (level == 0) {
+      center = boxCenter + randomVec3(rng, -side / 2 + nestRadius,
+                                      side / 2 - nestRadius);
+    }
+
+    float radius = nestRadius * (1.0f - static_cast<float>(level) / depth);
+    glm::vec3 jitter = randomVec3(rng, -0.1f, 0.1f) * (nestRadius - radius);
+    world.spheres.push_back({.center = center + jitter,
+                             .radius = radius,
+                             .material = randomMaterial(rng)});
+  }
+}
+
+// Every sphere has a radius of a tenth to a quarter of the box, with all
+// the centres in its middle quarter.
+void addOverlapping(World &world, Rng &rng, uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    world.spheres.push_back(
+        {.center = boxCenter + randomVec3(rng, -side / 8, side / 8),
+         .radius = randomFloat(rng, 0.1f, 0.25f) * side,
+         .material = randomMaterial(rng)});
+  }
+}
+
+} // namespace
+
+World randomScene(uint32_t count, uint64_t seed) {
+  Rng rng{seed};
+  World world = groundAndPalette(rng, count);
+
+  float spacing = spacingFor(count);
+
+  for (uint32_t i = 0; i < count; i++) {
+    glm::vec3 center = randomVec3(rng, -side / 2, side / 2);
+    center.z -= side / 2 + 1.5f;
+    float radius = randomFloat(rng, 0.1f, 0.4f) * spacing;
+    uint32_t material = randomMaterial(rng);
+
+    world.spheres.push_back(
+        {.center = center, .radius = radius, .material = material});
+  }
+
+  return world;
+}
+
+const char *sceneLayoutName(SceneLayout layout) {
+  switch (layout) {
+  case SceneLayout::Random:
+    return "random";
+  case SceneLayout::Grid:
+    return "grid";
+  case SceneLayout::Clusters:
+    return "clusters";
+  case SceneLayout::Nested:
+    return "nested";
+  case SceneLayout::Overlapping:
+    return "overlapping";
+  }
+  return "unknown";
+}
+
+World generateScene(SceneLayout layout, uint32_t count, uint64_t seed) {
+  if (layout == SceneLayout::Random) {
+    return randomScene(count, seed);
+  }
+
+  Rng rng{seed};
+  World world = groundAndPalette(rng, count);
+
+  switch (layout) {
+  case SceneLayout::Grid:
+    addGrid(world, rng, count);
+    break;
+  case SceneLayout::Clusters:
+    addClusters(world, rng, count);
+    break;
+  case SceneLayout::Nested:
+    addNested(world, rng, count);
+    break;
+  case SceneLayout::Overlapping:
+    addOverlapping(world, rng, count);
+    break;
+  case SceneLayout::Random:
+    break;
+  }
+
+  return world;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+#include "world.h"
+
+// The three-sphere scene the windowed renderer has always shown, plus a
+// light above it and out of view.
+World defaultScene();
+
+// count spheres with random sizes and materials packed into a box in front
+// of the camera, above a large ground sphere and below one light. The same
+// seed always gives the same world.
+World randomScene(uint32_t count, uint64_t seed);
+
+// Procedural layouts for scaling tests. All of them put count spheres in
+// the same box as randomScene(), with the same ground and light, and are
+// reproducible from the seed.
+enum class SceneLayout {
+  // randomScene().
+  Random,
+  // A regular lattice of equal, disjoint spheres; the friendliest case.
+  Grid,
+  // Dense clumps separated by empty space, the uneven distribution a SAH
+  // split has to find.
+  Clusters,
+  // Concentric shells: every box contains the next, so a ray reaching the
+  // innermost sphere has to descend through all of them.
+  Nested,
+  // Large spheres piled into a small volume; every ray overlaps many
+  // boxes, the worst case for any hierarchy.
+  Overlapping,
+};
+
+constexpr SceneLayout sceneLayouts[] = {
+    SceneLayout::Random, SceneLayout::Grid, SceneLayout::Clusters,
+    SceneLayout::Nested, SceneLayout::Overlapping};
+
+const char *sceneLayoutName(SceneLayout layout);
+
+World generateScene(SceneLayout layout, uint32_t count, uint64_t seed);
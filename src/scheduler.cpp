@@ -0,0 +1,118 @@
+#include "scheduler.h"
+
+#include <algorithm>
+
+TileScheduler::TileScheduler(uint32_t threadCount) {
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  for (uint32_t i = 0; i < threadCount; i++) {
+    queues.push_back(std::make_unique<Queue>());
+  }
+
+  for (uint32_t i = 0; i < threadCount; i++) {
+    workers.emplace_back(&TileScheduler::workerLoop, this, i);
+  }
+}
+
+TileScheduler::~TileScheduler() {
+  {
+    std::lock_guard lock{mutex};
+    stopping = true;
+  }
+  wake.notify_all();
+
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
+
+void TileScheduler::run(uint32_t w, uint32_t h, uint32_t tileSize,
+                        const std::function<void(const Tile &, uint32_t)> &fn) {
+  tiles.clear();
+  for (uint32_t y = 0; y < h; y += tileSize) {
+    for (uint32_t x = 0; x < w; x += tileSize) {
+      tiles.push_back({x, y, std::min(x + tileSize, w), std::min(y + tileSize, h)});
+    }
+  }
+
+  if (tiles.empty()) {
+    return;
+  }
+
+  // Hand every worker a contiguous band of tiles so neighbouring tiles share
+  // cache; stealing evens out whatever the bands get wrong.
+  uint32_t count = threadCount();
+  for (uint32_t i = 0; i < count; i++) {
+    std::lock_guard lock{queues[i]->mutex};
+    queues[i]->begin = static_cast<uint32_t>(tiles.size() * i / count);
+    queues[i]->end = static_cast<uint32_t>(tiles.size() * (i + 1) / count);
+  }
+
+  std::unique_lock lock{mutex};
+  job = &fn;
+  activeWorkers = count;
+  generation++;
+  wake.notify_all();
+
+  done.wait(lock, [this] { return activeWorkers == 0; });
+  job = nullptr;
+}
+
+void TileScheduler::workerLoop(uint32_t index) {
+  uint64_t seen = 0;
+
+  while (true) {
+    const std::function<void(const Tile &, uint32_t)> *fn;
+    {
+      std::unique_lock lock{mutex};
+      wake.wait(lock, [&] { return stopping || generation != seen; });
+      if (stopping) {
+        return;
+      }
+      seen = generation;
+      fn = job;
+    }
+
+    Tile tile;
+    while (pop(index, tile) || steal(index, tile)) {
+      (*fn)(tile, index);
+    }
+
+    std::lock_guard lock{mutex};
+    if (--activeWorkers == 0) {
+      done.notify_one();
+    }
+  }
+}
+
+bool TileScheduler::pop(uint32_t index, Tile &tile) {
+  Queue &queue = *queues[index];
+  std::lock_guard lock{queue.mutex};
+
+  if (queue.begin == queue.end) {
+    return false;
+  }
+
+  tile = tiles[--queue.end];
+  return true;
+}
+
+bool TileScheduler::steal(uint32_t index, Tile &tile) {
+  uint32_t count = threadCount();
+
+  for (uint32_t i = 1; i < count; i++) {
+    Queue &victim = *queues[(index + i) % count];
+    std::lock_guard lock{victim.mutex};
+
+    if (victim.begin == victim.end) {
+      continue;
+    }
+
+    tile = tiles[victim.begin++];
+    return true;
+  }
+
+  return false;
+}
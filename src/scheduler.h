@@ -0,0 +1,60 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Tile {
+  uint32_t x0, y0;
+  uint32_t x1, y1;
+};
+
+// Persistent pool of render workers. Every worker owns a contiguous range
+// of the frame's tile list; it pops from the back of its own range and,
+// once that runs dry, steals from the front of its neighbours so expensive
+// regions don't serialize a frame. The tile list is reused between runs,
+// so a run that keeps the frame size allocates nothing.
+class TileScheduler {
+public:
+  explicit TileScheduler(uint32_t threadCount = 0);
+  ~TileScheduler();
+
+  TileScheduler(const TileScheduler &) = delete;
+  TileScheduler &operator=(const TileScheduler &) = delete;
+
+  // Splits [0, w) x [0, h) into tileSize x tileSize tiles and blocks until
+  // fn has been called for every one of them. fn receives the tile and the
+  // index of the worker running it.
+  void run(uint32_t w, uint32_t h, uint32_t tileSize,
+           const std::function<void(const Tile &, uint32_t)> &fn);
+
+  uint32_t threadCount() const { return static_cast<uint32_t>(workers.size()); }
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    uint32_t begin = 0;
+    uint32_t end = 0;
+  };
+
+  void workerLoop(uint32_t index);
+  bool pop(uint32_t index, Tile &tile);
+  bool steal(uint32_t index, Tile &tile);
+
+  std::vector<std::thread> workers;
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<Tile> tiles;
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+
+  const std::function<void(const Tile &, uint32_t)> *job = nullptr;
+  uint64_t generation = 0;
+  uint32_t activeWorkers = 0;
+  bool stopping = false;
+};
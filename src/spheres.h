@@ -0,0 +1,314 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <limits>
+#include <vector>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "ray.h"
+
+#if defined(__AVX512F__)
+constexpr uint32_t simdWidth = 16;
+#elif defined(__AVX2__)
+constexpr uint32_t simdWidth = 8;
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+constexpr uint32_t simdWidth = 4;
+#else
+constexpr uint32_t simdWidth = 1;
+#endif
+
+struct PrimitiveHit {
+  float t;
+  uint32_t index;
+};
+
+constexpr uint32_t noPrimitive = std::numeric_limits<uint32_t>::max();
+
+// Sphere geometry split into one array per component so the intersection
+// kernel can load simdWidth spheres at once. Materials stay in World; ids
+// maps a slot back to its index in World::spheres. Arrays are padded by
+// simdWidth - 1 slots so a full-width load at any slot stays in bounds.
+// Radii are stored squared, the only form the intersection test uses.
+struct SphereSoA {
+  std::vector<float> centerX;
+  std::vector<float> centerY;
+  std::vector<float> centerZ;
+  std::vector<float> radiusSquared;
+  std::vector<uint32_t> ids;
+
+  uint32_t size() const { return static_cast<uint32_t>(ids.size()); }
+
+  void assign(const std::vector<Sphere> &spheres,
+              const std::vector<uint32_t> &order) {
+    size_t padded = order.size() + simdWidth - 1;
+    centerX.assign(padded, 0.0f);
+    centerY.assign(padded, 0.0f);
+    centerZ.assign(padded, 0.0f);
+    radiusSquared.assign(padded, 0.0f);
+    ids = order;
+
+    for (size_t i = 0; i < order.size(); i++) {
+      const Sphere &sphere = spheres[order[i]];
+      centerX[i] = sphere.center.x;
+      centerY[i] = sphere.center.y;
+      centerZ[i] = sphere.center.z;
+      radiusSquared[i] = sphere.radius * sphere.radius;
+    }
+  }
+
+  // Nearest root in (minT, maxT) among slots [first, first + count), with
+  // the same root selection as Ray::intersects(). Returns {maxT,
+  // noPrimitive} when nothing is hit. Relies on ray.direction being unit
+  // length, so each test is a handful of FMAs and one square root.
+  PrimitiveHit nearest(const Ray &ray, uint32_t first, uint32_t count,
+                       float minT, float maxT) const;
+};
+
+inline PrimitiveHit nearestScalar(const SphereSoA &soa, const Ray &ray,
+                                  uint32_t first, uint32_t count, float minT,
+                                  float maxT) {
+  PrimitiveHit best{maxT, noPrimitive};
+
+  for (uint32_t i = first; i < first + count; i++) {
+    glm::vec3 oc =
+        glm::vec3{soa.centerX[i], soa.centerY[i], soa.centerZ[i]} - ray.origin;
+    float h = glm::dot(ray.direction, oc);
+    float c = glm::dot(oc, oc) - soa.radiusSquared[i];
+    float d = h * h - c;
+
+    if (d < 0) {
+      continue;
+    }
+
+    d = glm::sqrt(d);
+
+    float t = h - d;
+    if (t <= minT || t >= best.t) {
+      t = h + d;
+      if (t <= minT || t >= best.t) {
+        continue;
+      }
+    }
+
+    best = {t, i};
+  }
+
+  return best;
+}
+
+#if defined(__AVX512F__)
+
+inline PrimitiveHit SphereSoA::nearest(const Ray &ray, uint32_t first,
+                                       uint32_t count, float minT,
+                                       float maxT) const {
+  const __m512 ox = _mm512_set1_ps(ray.origin.x);
+  const __m512 oy = _mm512_set1_ps(ray.origin.y);
+  const __m512 oz = _mm512_set1_ps(ray.origin.z);
+  const __m512 dx = _mm512_set1_ps(ray.direction.x);
+  const __m512 dy = _mm512_set1_ps(ray.direction.y);
+  const __m512 dz = _mm512_set1_ps(ray.direction.z);
+  const __m512 lo = _mm512_set1_ps(minT);
+  const __m512i step = _mm512_set1_epi32(16);
+
+  __m512 bestT = _mm512_set1_ps(maxT);
+  __m512i bestIdx = _mm512_set1_epi32(static_cast<int>(noPrimitive));
+  __m512i idx = _mm512_add_epi32(
+      _mm512_set1_epi32(static_cast<int>(first)),
+      _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+
+  for (uint32_t i = 0; i < count; i += 16) {
+    uint32_t lanes = count - i < 16 ? count - i : 16;
+    __mmask16 valid = static_cast<__mmask16>((1u << lanes) - 1);
+    uint32_t s = first + i;
+
+    __m512 ocx = _mm512_sub_ps(_mm512_loadu_ps(&centerX[s]), ox);
+    __m512 ocy = _mm512_sub_ps(_mm512_loadu_ps(&centerY[s]), oy);
+    __m512 ocz = _mm512_sub_ps(_mm512_loadu_ps(&centerZ[s]), oz);
+    __m512 r2 = _mm512_loadu_ps(&radiusSquared[s]);
+
+    __m512 h = _mm512_fmadd_ps(dz, ocz,
+                               _mm512_fmadd_ps(dy, ocy, _mm512_mul_ps(dx, ocx)));
+    __m512 c = _mm512_fmadd_ps(
+        ocz, ocz,
+        _mm512_fmadd_ps(ocy, ocy, _mm512_fmsub_ps(ocx, ocx, r2)));
+    __m512 d = _mm512_fmsub_ps(h, h, c);
+
+    valid = _mm512_mask_cmp_ps_mask(valid, d, _mm512_setzero_ps(), _CMP_GE_OQ);
+    d = _mm512_sqrt_ps(_mm512_max_ps(d, _mm512_setzero_ps()));
+
+    __m512 t0 = _mm512_sub_ps(h, d);
+    __m512 t1 = _mm512_add_ps(h, d);
+
+    __mmask16 near = _mm512_cmp_ps_mask(t0, lo, _CMP_GT_OQ) &
+                     _mm512_cmp_ps_mask(t0, bestT, _CMP_LT_OQ);
+    __m512 t = _mm512_mask_blend_ps(near, t1, t0);
+    __mmask16 hit = valid & _mm512_cmp_ps_mask(t, lo, _CMP_GT_OQ) &
+                    _mm512_cmp_ps_mask(t, bestT, _CMP_LT_OQ);
+
+    bestT = _mm512_mask_blend_ps(hit, bestT, t);
+    bestIdx = _mm512_mask_blend_epi32(hit, bestIdx, idx);
+    idx = _mm512_add_epi32(idx, step);
+  }
+
+  alignas(64) float ts[16];
+  alignas(64) uint32_t indices[16];
+  _mm512_store_ps(ts, bestT);
+  _mm512_store_si512(indices, bestIdx);
+
+  PrimitiveHit best{maxT, noPrimitive};
+  for (uint32_t i = 0; i < 16; i++) {
+    if (ts[i] < best.t) {
+      best = {ts[i], indices[i]};
+    }
+  }
+  return best;
+}
+
+#elif defined(__AVX2__)
+
+inline PrimitiveHit SphereSoA::nearest(const Ray &ray, uint32_t first,
+                                       uint32_t count, float minT,
+                                       float maxT) const {
+  const __m256 ox = _mm256_set1_ps(ray.origin.x);
+  const __m256 oy = _mm256_set1_ps(ray.origin.y);
+  const __m256 oz = _mm256_set1_ps(ray.origin.z);
+  const __m256 dx = _mm256_set1_ps(ray.direction.x);
+  const __m256 dy = _mm256_set1_ps(ray.direction.y);
+  const __m256 dz = _mm256_set1_ps(ray.direction.z);
+  const __m256 lo = _mm256_set1_ps(minT);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+  __m256 bestT = _mm256_set1_ps(maxT);
+  __m256i bestIdx = _mm256_set1_epi32(static_cast<int>(noPrimitive));
+
+  for (uint32_t i = 0; i < count; i += 8) {
+    uint32_t s = first + i;
+    __m256i idx = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(s)), lane);
+    __m256 valid = _mm256_castsi256_ps(_mm256_cmpgt_epi32(
+        _mm256_set1_epi32(static_cast<int>(count - i)), lane));
+
+    __m256 ocx = _mm256_sub_ps(_mm256_loadu_ps(&centerX[s]), ox);
+    __m256 ocy = _mm256_sub_ps(_mm256_loadu_ps(&centerY[s]), oy);
+    __m256 ocz = _mm256_sub_ps(_mm256_loadu_ps(&centerZ[s]), oz);
+    __m256 r2 = _mm256_loadu_ps(&radiusSquared[s]);
+
+    __m256 h = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(dx, ocx), _mm256_mul_ps(dy, ocy)),
+        _mm256_mul_ps(dz, ocz));
+    __m256 c = _mm256_sub_ps(
+        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)),
+                      _mm256_mul_ps(ocz, ocz)),
+        r2);
+    __m256 d = _mm256_sub_ps(_mm256_mul_ps(h, h), c);
+
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(d, zero, _CMP_GE_OQ));
+    d = _mm256_sqrt_ps(_mm256_max_ps(d, zero));
+
+    __m256 t0 = _mm256_sub_ps(h, d);
+    __m256 t1 = _mm256_add_ps(h, d);
+
+    __m256 near = _mm256_and_ps(_mm256_cmp_ps(t0, lo, _CMP_GT_OQ),
+                                _mm256_cmp_ps(t0, bestT, _CMP_LT_OQ));
+    __m256 t = _mm256_blendv_ps(t1, t0, near);
+    __m256 hit = _mm256_and_ps(
+        valid, _mm256_and_ps(_mm256_cmp_ps(t, lo, _CMP_GT_OQ),
+                             _mm256_cmp_ps(t, bestT, _CMP_LT_OQ)));
+
+    bestT = _mm256_blendv_ps(bestT, t, hit);
+    bestIdx = _mm256_castps_si256(_mm256_blendv_ps(
+        _mm256_castsi256_ps(bestIdx), _mm256_castsi256_ps(idx), hit));
+  }
+
+  alignas(32) float ts[8];
+  alignas(32) uint32_t indices[8];
+  _mm256_store_ps(ts, bestT);
+  _mm256_store_si256(reinterpret_cast<__m256i *>(indices), bestIdx);
+
+  PrimitiveHit best{maxT, noPrimitive};
+  for (uint32_t i = 0; i < 8; i++) {
+    if (ts[i] < best.t) {
+      best = {ts[i], indices[i]};
+    }
+  }
+  return best;
+}
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+inline PrimitiveHit SphereSoA::nearest(const Ray &ray, uint32_t first,
+                                       uint32_t count, float minT,
+                                       float maxT) const {
+  const float32x4_t ox = vdupq_n_f32(ray.origin.x);
+  const float32x4_t oy = vdupq_n_f32(ray.origin.y);
+  const float32x4_t oz = vdupq_n_f32(ray.origin.z);
+  const float32x4_t dx = vdupq_n_f32(ray.direction.x);
+  const float32x4_t dy = vdupq_n_f32(ray.direction.y);
+  const float32x4_t dz = vdupq_n_f32(ray.direction.z);
+  const float32x4_t lo = vdupq_n_f32(minT);
+  const float32x4_t zero = vdupq_n_f32(0.0f);
+  const uint32_t laneInit[4] = {0, 1, 2, 3};
+  const uint32x4_t lane = vld1q_u32(laneInit);
+
+  float32x4_t bestT = vdupq_n_f32(maxT);
+  uint32x4_t bestIdx = vdupq_n_u32(noPrimitive);
+
+  for (uint32_t i = 0; i < count; i += 4) {
+    uint32_t s = first + i;
+    uint32x4_t idx = vaddq_u32(vdupq_n_u32(s), lane);
+    uint32x4_t valid = vcltq_u32(lane, vdupq_n_u32(count - i));
+
+    float32x4_t ocx = vsubq_f32(vld1q_f32(&centerX[s]), ox);
+    float32x4_t ocy = vsubq_f32(vld1q_f32(&centerY[s]), oy);
+    float32x4_t ocz = vsubq_f32(vld1q_f32(&centerZ[s]), oz);
+    float32x4_t r2 = vld1q_f32(&radiusSquared[s]);
+
+    float32x4_t h = vfmaq_f32(vfmaq_f32(vmulq_f32(dx, ocx), dy, ocy), dz, ocz);
+    float32x4_t c = vsubq_f32(
+        vfmaq_f32(vfmaq_f32(vmulq_f32(ocx, ocx), ocy, ocy), ocz, ocz), r2);
+    float32x4_t d = vfmaq_f32(vnegq_f32(c), h, h);
+
+    valid = vandq_u32(valid, vcgeq_f32(d, zero));
+    d = vsqrtq_f32(vmaxq_f32(d, zero));
+
+    float32x4_t t0 = vsubq_f32(h, d);
+    float32x4_t t1 = vaddq_f32(h, d);
+
+    uint32x4_t near = vandq_u32(vcgtq_f32(t0, lo), vcltq_f32(t0, bestT));
+    float32x4_t t = vbslq_f32(near, t0, t1);
+    uint32x4_t hit = vandq_u32(
+        valid, vandq_u32(vcgtq_f32(t, lo), vcltq_f32(t, bestT)));
+
+    bestT = vbslq_f32(hit, t, bestT);
+    bestIdx = vbslq_u32(hit, idx, bestIdx);
+  }
+
+  float ts[4];
+  uint32_t indices[4];
+  vst1q_f32(ts, bestT);
+  vst1q_u32(indices, bestIdx);
+
+  PrimitiveHit best{maxT, noPrimitive};
+  for (uint32_t i = 0; i < 4; i++) {
+    if (ts[i] < best.t) {
+      best = {ts[i], indices[i]};
+    }
+  }
+  return best;
+}
+
+#else
+
+inline PrimitiveHit SphereSoA::nearest(const Ray &ray, uint32_t first,
+                                       uint32_t count, float minT,
+                                       float maxT) const {
+  return nearestScalar(*this, ray, first, count, minT, maxT);
+}
+
+#endif
@@ -0,0 +1,229 @@
+#include "streaming.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "profile.h"
+
+namespace {
+
+// Rays per scheduler task. Queues no longer than this are traced on the
+// calling thread, which is cheaper than waking the workers.
+constexpr uint32_t streamGrain = 1024;
+
+} // namespace
+
+void StreamTracer::begin(uint32_t maxPaths) {
+  paths.clear();
+  paths.reserve(maxPaths);
+}
+
+void StreamTracer::add(uint32_t pixel, const Ray &ray, const Sampler &sampler,
+                       float rayDepth) {
+  PROFILE_COUNT(Paths, 1);
+  paths.push_back({ray, glm::vec3{1.0f}, glm::vec3{0.0f}, {ray.origin, 0.0f},
+                   sampler, pixel, 0, rayDepth});
+}
+
+uint64_t StreamTracer::trace(
+    World &world, ChunkedScene &scene, TileScheduler &scheduler,
+    const std::function<void(uint32_t, const glm::vec3 &)> &sink,
+    const std::function<void(uint32_t, const FirstHit &)> &firstHitSink) {
+  uint64_t traced = 0;
+  bool first = true;
+
+  // Hands finished paths to the sink: those with no depth left and, unless
+  // all is set, those the last bounce didn't keep alive.
+  auto retire = [&](bool all) {
+    uint32_t live = 0;
+    for (uint32_t i = 0; i < size(); i++) {
+      if ((all || alive[i]) && paths[i].depth > 0) {
+        paths[live++] = paths[i];
+      } else {
+        sink(paths[i].pixel, paths[i].radiance);
+      }
+    }
+    paths.resize(live);
+  };
+  retire(true);
+
+  while (!paths.empty()) {
+    uint32_t count = size();
+    traced += count;
+
+    rays.resize(count);
+    hits.assign(count, {std::numeric_limits<float>::infinity(), {}, false});
+    for (uint32_t i = 0; i < count; i++) {
+      rays[i] = paths[i].ray;
+    }
+    traceRays<HitQuery::Closest>(scene, scheduler);
+
+    alive.assign(count, 0);
+    shadows.resize(count);
+    hasShadow.assign(count, 0);
+    scheduler.run(count, 1, streamGrain, [&](const Tile &tile, uint32_t) {
+      for (uint32_t i = tile.x0; i < tile.x1; i++) {
+        PathState &path = paths[i];
+        StreamHit &hit = hits[i];
+        PROFILE_COUNT(Rays, 1);
+
+        HitRecord record{hit.found ? &hit.sphere : nullptr, hit.t};
+        if (first && firstHitSink) {
+          firstHitSink(path.pixel, world.firstHit(path.ray, record));
+        }
+
+        if (!hit.found) {
+          path.radiance += path.throughput * World::background();
+          continue;
+        }
+
+        glm::vec3 p = path.ray.at(hit.t);
+        glm::vec3 n = (p - hit.sphere.center) / hit.sphere.radius;
+        glm::vec3 wo = -path.ray.direction;
+        const Material &mat = world.materials[hit.sphere.material];
+
+        path.radiance +=
+            path.throughput * world.emitted(mat, hit.sphere, path.previous);
+
+        if (world.sampleLight(p, n, wo, mat, path.sampler, shadows[i])) {
+          shadows[i].radiance *= path.throughput;
+          hasShadow[i] = 1;
+        }
+
+        BsdfSample sample = sampleBsdf(mat, n, wo, path.sampler);
+        path.previous = {p, sample.delta ? 0.0f : sample.pdf};
+        path.ray = Ray{p, sample.direction};
+
+        if (!World::survive(path.throughput, sample.weight, path.bounce,
+                            path.sampler)) {
+          continue;
+        }
+
+        path.bounce++;
+        path.depth--;
+        alive[i] = 1;
+      }
+    });
+
+    shadowPaths.clear();
+    rays.clear();
+    hits.clear();
+    for (uint32_t i = 0; i < count; i++) {
+      if (hasShadow[i]) {
+        shadowPaths.push_back(i);
+        rays.push_back(shadows[i].ray);
+        hits.push_back({shadows[i].maxT, {}, false});
+      }
+    }
+    traced += shadowPaths.size();
+    traceRays<HitQuery::Any>(scene, scheduler);
+
+    for (uint32_t k = 0; k < shadowPaths.size(); k++) {
+      if (!hits[k].found) {
+        paths[shadowPaths[k]].radiance += shadows[shadowPaths[k]].radiance;
+      }
+    }
+
+    retire(false);
+    first = false;
+  }
+
+  return traced;
+}
+
+template <HitQuery query>
+void StreamTracer::traceRays(ChunkedScene &scene, TileScheduler &scheduler) {
+  queueRays(scene, scheduler);
+  traceQueues<query>(scene, scheduler);
+}
+
+// Each worker collects the crossings of its share of the rays, and a
+// counting sort then turns them into one contiguous queue per chunk.
+void StreamTracer::queueRays(const ChunkedScene &scene,
+                             TileScheduler &scheduler) {
+  uint32_t workers = scheduler.threadCount();
+  crossings.resize(workers);
+  for (auto &list : crossings) {
+    list.clear();
+  }
+
+  uint32_t count = static_cast<uint32_t>(rays.size());
+  scheduler.run(count, 1, streamGrain, [&](const Tile &tile, uint32_t worker) {
+    std::vector<std::pair<uint32_t, ChunkCrossing>> &list = crossings[worker];
+    std::vector<ChunkCrossing> found;
+
+    for (uint32_t i = tile.x0; i < tile.x1; i++) {
+      found.clear();
+      scene.chunksAlong(rays[i], hits[i].t, found);
+      for (const ChunkCrossing &crossing : found) {
+        list.emplace_back(i, crossing);
+      }
+    }
+  });
+
+  uint32_t chunks = scene.chunkCount();
+  queueStart.assign(chunks + 1, 0);
+  for (const auto &list : crossings) {
+    for (const auto &[index, crossing] : list) {
+      queueStart[crossing.chunk + 1]++;
+    }
+  }
+  for (uint32_t c = 0; c < chunks; c++) {
+    queueStart[c + 1] += queueStart[c];
+  }
+
+  queued.resize(queueStart[chunks]);
+  std::vector<uint32_t> fill(queueStart.begin(), queueStart.end() - 1);
+  for (const auto &list : crossings) {
+    for (const auto &[index, crossing] : list) {
+      queued[fill[crossing.chunk]++] = {index, crossing.enter};
+    }
+  }
+}
+
+// Chunks already in memory go first, so a budget that holds the busiest
+// chunks keeps them across bounces and passes.
+template <HitQuery query>
+void StreamTracer::traceQueues(ChunkedScene &scene, TileScheduler &scheduler) {
+  chunkOrder.clear();
+  for (uint32_t c = 0; c < scene.chunkCount(); c++) {
+    if (queueStart[c + 1] > queueStart[c]) {
+      chunkOrder.push_back(c);
+    }
+  }
+  std::stable_partition(chunkOrder.begin(), chunkOrder.end(),
+                        [&](uint32_t c) { return scene.isResident(c); });
+
+  for (uint32_t c : chunkOrder) {
+    const Chunk &chunk = scene.acquire(c);
+    uint32_t begin = queueStart[c];
+    uint32_t count = queueStart[c + 1] - begin;
+
+    // Each ray is queued on a chunk once, so no two workers share a hit.
+    auto traceRange = [&](uint32_t from, uint32_t to) {
+      PROFILE_SCOPE(Hit);
+
+      for (uint32_t k = from; k < to; k++) {
+        const QueuedRay &ray = queued[begin + k];
+        StreamHit &hit = hits[ray.index];
+        if (ray.enter >= hit.t || (query == HitQuery::Any && hit.found)) {
+          continue;
+        }
+
+        PrimitiveHit h = chunk.bvh.hit<query>(rays[ray.index], 0.001f, hit.t);
+        if (h.index != noPrimitive) {
+          hit = {h.t, chunk.spheres[h.index], true};
+        }
+      }
+    };
+
+    if (count <= streamGrain) {
+      traceRange(0, count);
+      continue;
+    }
+
+    scheduler.run(count, 1, streamGrain, [&](const Tile &tile, uint32_t) {
+      traceRange(tile.x0, tile.x1);
+    });
+  }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "chunked_scene.h"
+#include "scheduler.h"
+#include "wavefront.h"
+#include "world.h"
+
+// Paths per StreamTracer batch. Large batches put more rays in every chunk
+// queue, so each page-in is shared by more of them.
+constexpr uint32_t streamBatchSize = 256 * 1024;
+
+// Breadth-first tracer for a ChunkedScene. Every bounce, each live ray is
+// queued on every chunk whose bounds it crosses; the chunks are then
+// visited one at a time, resident ones first, and a chunk's whole queue is
+// traced across the workers while it is in memory. A chunk is paged in at
+// most once per bounce however many rays reach it, instead of once per ray.
+// Rays are skipped in a chunk they enter beyond their closest hit so far.
+// Shadow rays of a bounce go through the chunks the same way, as any-hit
+// queries, once every path has been shaded.
+//
+// Shading matches World::shade() path for path.
+class StreamTracer {
+public:
+  // Drops the previous batch and makes room for up to maxPaths paths.
+  void begin(uint32_t maxPaths);
+
+  void add(uint32_t pixel, const Ray &ray, const Sampler &sampler,
+           float rayDepth);
+
+  uint32_t size() const { return static_cast<uint32_t>(paths.size()); }
+
+  // Runs every added path to completion, calling sink(pixel, radiance)
+  // once per path, and firstHitSink(pixel, firstHit), when set, once per
+  // path that started with depth left. firstHitSink is called from the
+  // workers, but never twice for the same path at once. Returns the rays
+  // traced, shadow rays included.
+  uint64_t trace(
+      World &world, ChunkedScene &scene, TileScheduler &scheduler,
+      const std::function<void(uint32_t, const glm::vec3 &)> &sink,
+      const std::function<void(uint32_t, const FirstHit &)> &firstHitSink);
+
+private:
+  // Chunk geometry isn't kept once the chunk is dropped, so a hit holds a
+  // copy of its sphere.
+  struct StreamHit {
+    float t;
+    Sphere sphere;
+    bool found;
+  };
+
+  struct QueuedRay {
+    uint32_t index;
+    float enter;
+  };
+
+  // Traces rays[i] into hits[i], which holds the maxT going in.
+  template <HitQuery query>
+  void traceRays(ChunkedScene &scene, TileScheduler &scheduler);
+  void queueRays(const ChunkedScene &scene, TileScheduler &scheduler);
+  template <HitQuery query>
+  void traceQueues(ChunkedScene &scene, TileScheduler &scheduler);
+
+  std::vector<PathState> paths;
+  std::vector<uint8_t> alive;
+  std::vector<ShadowRay> shadows;
+  std::vector<uint8_t> hasShadow;
+  std::vector<uint32_t> shadowPaths;
+
+  // The rays of the current trace, path or shadow rays.
+  std::vector<Ray> rays;
+  std::vector<StreamHit> hits;
+
+  // Per worker crossings, then bucketed by chunk: chunk c's queue is
+  // queued[queueStart[c], queueStart[c + 1]).
+  std::vector<std::vector<std::pair<uint32_t, ChunkCrossing>>> crossings;
+  std::vector<uint32_t> queueStart;
+  std::vector<QueuedRay> queued;
+  std::vector<uint32_t> chunkOrder;
+};
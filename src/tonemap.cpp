@@ -0,0 +1,47 @@
+#include "tonemap.h"
+
+namespace {
+
+template <ToneCurve curve> glm::vec3 applyCurve(const glm::vec3 &c) {
+  if constexpr (curve == ToneCurve::Reinhard) {
+    return c / (1.0f + c);
+  } else if constexpr (curve == ToneCurve::Aces) {
+    return (c * (2.51f * c + 0.03f)) / (c * (2.43f * c + 0.59f) + 0.14f);
+  } else {
+    return c;
+  }
+}
+
+// The curve is fixed per instantiation so the loop body has no branches
+// and the compiler can vectorize it.
+template <ToneCurve curve>
+void toneMapSpan(const glm::vec3 *linear, uint32_t *pixels, size_t count,
+                 float scale) {
+  for (size_t i = 0; i < count; i++) {
+    glm::vec3 mapped = applyCurve<curve>(linear[i] * scale);
+    glm::vec3 pixelColor = glm::clamp(glm::sqrt(mapped), 0.0f, 1.0f);
+
+    pixels[i] = static_cast<uint32_t>(pixelColor.r * 255) << 24 |
+                static_cast<uint32_t>(pixelColor.g * 255) << 16 |
+                static_cast<uint32_t>(pixelColor.b * 255) << 8 | 0x000000FF;
+  }
+}
+
+} // namespace
+
+void toneMap(const glm::vec3 *linear, uint32_t *pixels, size_t count,
+             const ToneMapSettings &settings) {
+  float scale = glm::exp2(settings.exposure);
+
+  switch (settings.curve) {
+  case ToneCurve::Clamp:
+    toneMapSpan<ToneCurve::Clamp>(linear, pixels, count, scale);
+    break;
+  case ToneCurve::Reinhard:
+    toneMapSpan<ToneCurve::Reinhard>(linear, pixels, count, scale);
+    break;
+  case ToneCurve::Aces:
+    toneMapSpan<ToneCurve::Aces>(linear, pixels, count, scale);
+    break;
+  }
+}
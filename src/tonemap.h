@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// Curve applied to exposed linear radiance before gamma.
+enum class ToneCurve {
+  // Clamps at 1, the original look.
+  Clamp,
+  // c / (1 + c) per channel.
+  Reinhard,
+  // Narkowicz's fit of the ACES filmic curve.
+  Aces,
+};
+
+struct ToneMapSettings {
+  // In stops; the radiance is scaled by 2^exposure.
+  float exposure = 0.0f;
+  ToneCurve curve = ToneCurve::Clamp;
+};
+
+// Exposes, applies the curve and gamma 2, and quantizes count linear
+// pixels to RGBA8888. Changing the settings only needs this pass again,
+// not new samples.
+void toneMap(const glm::vec3 *linear, uint32_t *pixels, size_t count,
+             const ToneMapSettings &settings);
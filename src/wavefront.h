@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <glm/glm.hpp>
+
+#include "arena.h"
+#include "profile.h"
+#include "random.h"
+#include "ray.h"
+#include "world.h"
+
+struct PathState {
+  Ray ray;
+  glm::vec3 throughput;
+  // Gathered so far; handed to the sink when the path ends.
+  glm::vec3 radiance;
+  PathVertex previous;
+  Sampler sampler;
+  uint32_t pixel;
+  uint32_t bounce;
+  float depth;
+};
+
+// Breadth-first path tracer. Instead of following one path to the end,
+// every bounce runs as separate stages over the whole batch: intersect all
+// live rays, retire the misses, group the hits by material kind, then shade
+// each group with its own branch-free scatter. All buffers live in the
+// worker's arena, sized once per batch in begin().
+struct Wavefront {
+  Arena arena;
+
+  PathState *paths = nullptr;
+  PathState *next = nullptr;
+  HitRecord *hits = nullptr;
+  uint32_t *diffuse = nullptr;
+  uint32_t *metallic = nullptr;
+
+  uint32_t pathCount = 0;
+  uint32_t nextCount = 0;
+  uint32_t capacity = 0;
+
+  // Drops the previous batch and makes room for up to maxPaths paths.
+  void begin(uint32_t maxPaths) {
+    arena.reset();
+    paths = arena.allocate<PathState>(maxPaths);
+    next = arena.allocate<PathState>(maxPaths);
+    hits = arena.allocate<HitRecord>(maxPaths);
+    diffuse = arena.allocate<uint32_t>(maxPaths);
+    metallic = arena.allocate<uint32_t>(maxPaths);
+    pathCount = 0;
+    capacity = maxPaths;
+  }
+
+  // Starts a path for pixel. Paths begin with rayDepth bounces left.
+  void add(uint32_t pixel, const Ray &ray, const Sampler &sampler, float rayDepth) {
+    PROFILE_COUNT(Paths, 1);
+    paths[pathCount++] = {ray, glm::vec3{1.0f}, glm::vec3{0.0f},
+                          {ray.origin, 0.0f}, sampler, pixel, 0, rayDepth};
+  }
+
+  // Runs every added path to completion. sink(pixel, radiance) is called
+  // exactly once per path. Results match World::color() path for path.
+  template <typename Sink> void trace(World &world, Sink &&sink) {
+    trace(world, sink, [](uint32_t, const FirstHit &) {});
+  }
+
+  // Same, and also calls firstHitSink(pixel, firstHit) once per path that
+  // started with depth left.
+  template <typename Sink, typename FirstHitSink>
+  void trace(World &world, Sink &&sink, FirstHitSink &&firstHitSink) {
+    bool first = true;
+
+    while (pathCount > 0) {
+      for (uint32_t i = 0; i < pathCount; i++) {
+        hits[i] = paths[i].depth > 0 ? world.hit(paths[i].ray)
+                                     : HitRecord{nullptr, 0.0f};
+      }
+
+      if (first) {
+        for (uint32_t i = 0; i < pathCount; i++) {
+          if (paths[i].depth > 0) {
+            firstHitSink(paths[i].pixel, world.firstHit(paths[i].ray, hits[i]));
+          }
+        }
+        first = false;
+      }
+
+      uint32_t diffuseCount = 0;
+      uint32_t metallicCount = 0;
+      for (uint32_t i = 0; i < pathCount; i++) {
+        PathState &path = paths[i];
+
+        if (path.depth <= 0) {
+          sink(path.pixel, path.radiance);
+        } else if (hits[i].sphere == nullptr) {
+          sink(path.pixel,
+               path.radiance + path.throughput * World::background());
+        } else if (world.materials[hits[i].sphere->material].kind() ==
+                   MaterialKind::Metallic) {
+          metallic[metallicCount++] = i;
+        } else {
+          diffuse[diffuseCount++] = i;
+        }
+      }
+
+      nextCount = 0;
+
+      scatterGroup<MaterialKind::Metallic>(world, metallic, metallicCount,
+                                           sink);
+      scatterGroup<MaterialKind::Diffuse>(world, diffuse, diffuseCount, sink);
+
+      std::swap(paths, next);
+      pathCount = nextCount;
+    }
+  }
+
+private:
+  // Shades one material group; kind is fixed per instantiation, so the
+  // BSDF sampling has no material branch. Shadow rays are traced right
+  // away rather than as a stage of their own.
+  template <MaterialKind kind, typename Sink>
+  void scatterGroup(World &world, const uint32_t *group, uint32_t count,
+                    Sink &sink) {
+    for (uint32_t k = 0; k < count; k++) {
+      PathState &path = paths[group[k]];
+      const HitRecord &hit = hits[group[k]];
+      glm::vec3 p, n;
+      const Material &mat = surface(world, path, hit, p, n);
+      glm::vec3 wo = -path.ray.direction;
+
+      path.radiance +=
+          path.throughput * world.emitted(mat, *hit.sphere, path.previous);
+
+      ShadowRay shadow;
+      if (world.sampleLight(p, n, wo, mat, path.sampler, shadow) &&
+          world.hit<HitQuery::Any>(shadow.ray, shadow.maxT).sphere ==
+              nullptr) {
+        path.radiance += path.throughput * shadow.radiance;
+      }
+
+      BsdfSample sample = sampleBsdf<kind>(mat, n, wo, path.sampler);
+      path.previous = {p, sample.delta ? 0.0f : sample.pdf};
+      path.ray = Ray{p, sample.direction};
+      advance(path, sample.weight, sink);
+    }
+  }
+
+  static const Material &surface(const World &world, const PathState &path,
+                                 const HitRecord &hit, glm::vec3 &p,
+                                 glm::vec3 &n) {
+    p = path.ray.at(hit.t);
+    n = (p - hit.sphere->center) / hit.sphere->radius;
+    return world.materials[hit.sphere->material];
+  }
+
+  template <typename Sink>
+  void advance(PathState &path, const glm::vec3 &weight, Sink &sink) {
+    if (!World::survive(path.throughput, weight, path.bounce, path.sampler)) {
+      sink(path.pixel, path.radiance);
+      return;
+    }
+
+    path.bounce++;
+    path.depth--;
+    next[nextCount++] = path;
+  }
+};
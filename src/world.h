@@ -0,0 +1,310 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <limits>
+#include <vector>
+
+#include "bsdf.h"
+#include "bvh.h"
+#include "packet.h"
+#include "profile.h"
+#include "ray.h"
+
+// Rays traced by hit() on this thread, for throughput reporting.
+inline thread_local uint64_t raysTraced = 0;
+
+constexpr uint32_t rouletteDepth = 3;
+constexpr float minThroughput = 1e-4f;
+
+// Auxiliary outputs of a path's first hit, which guide the denoiser. A
+// miss has the background as albedo and a normal facing back along the
+// ray.
+struct FirstHit {
+  glm::vec3 albedo;
+  glm::vec3 normal;
+};
+
+// Shadow rays stop this fraction short of the light they aim at, so they
+// never find the light itself.
+constexpr float shadowEpsilon = 1e-4f;
+
+// Where a path last scattered, for weighting emission found by the next
+// ray. pdf is the BSDF density the ray was drawn with, or 0 after a camera
+// ray or a delta bounce, which light sampling can't reproduce.
+struct PathVertex {
+  glm::vec3 point;
+  float pdf;
+};
+
+// A light sample waiting on its shadow ray: radiance is added to the path,
+// times its throughput, unless something lies within maxT along ray.
+struct ShadowRay {
+  Ray ray;
+  float maxT;
+  glm::vec3 radiance;
+};
+
+struct World {
+  Camera camera;
+  std::vector<Sphere> spheres;
+  std::vector<Material> materials;
+  Bvh bvh;
+  // Copies of the emissive spheres, for next-event estimation. build() and
+  // refit() keep them current; so must anything else that edits spheres.
+  std::vector<Sphere> lights;
+
+  // firstHit, when given, receives the first hit's auxiliary outputs.
+  glm::vec3 color(const Ray &ray, float depth, Sampler &sampler,
+                  FirstHit *firstHit = nullptr) {
+    PROFILE_COUNT(Paths, 1);
+
+    if (depth <= 0) {
+      return glm::vec3{0.0};
+    }
+
+    HitRecord record = hit(ray);
+    if (firstHit != nullptr) {
+      *firstHit = this->firstHit(ray, record);
+    }
+
+    return shade(ray, record, depth, sampler);
+  }
+
+  // Traces the first hit of every lane as a packet; the paths then diverge
+  // too much to stay coherent, so each lane continues on its own.
+  void color(const RayPacket &packet, float depth, Sampler *samplers,
+             glm::vec3 *colors, FirstHit *firstHits = nullptr) {
+    PROFILE_COUNT(Paths, packet.count);
+    PROFILE_COUNT(Rays, packet.count);
+
+    PrimitiveHit hits[packetSize];
+    {
+      PROFILE_SCOPE(Hit);
+      bvh.hit(packet, 0.001f, std::numeric_limits<float>::infinity(), hits);
+    }
+    raysTraced += packet.count;
+
+    for (uint32_t i = 0; i < packet.count; i++) {
+      HitRecord record{nullptr, hits[i].t};
+      if (hits[i].index != noPrimitive) {
+        record.sphere = &spheres[hits[i].index];
+      }
+      if (firstHits != nullptr) {
+        firstHits[i] = firstHit(packet.ray(i), record);
+      }
+
+      colors[i] = depth <= 0 ? glm::vec3{0.0}
+                             : shade(packet.ray(i), record, depth, samplers[i]);
+    }
+  }
+
+  // Follows the path from an already traced hit, one loop iteration per
+  // bounce. Each hit adds its emission, weighted against light sampling,
+  // and a light sample of its own, then continues along a BSDF sample. The
+  // background is only reached by BSDF samples and needs no weight.
+  glm::vec3 shade(Ray ray, HitRecord record, float depth, Sampler &sampler) {
+    glm::vec3 radiance{0.0f};
+    glm::vec3 throughput{1.0f};
+    PathVertex previous{ray.origin, 0.0f};
+
+    for (uint32_t bounce = 0; depth > 0; bounce++, depth--) {
+      Sphere *sphere = record.sphere;
+
+      if (sphere == nullptr) {
+        return radiance + throughput * background();
+      }
+
+      glm::vec3 p = ray.at(record.t);
+      glm::vec3 n = (p - sphere->center) / sphere->radius;
+      glm::vec3 wo = -ray.direction;
+
+      const Material &mat = materials[sphere->material];
+      radiance += throughput * emitted(mat, *sphere, previous);
+
+      ShadowRay shadow;
+      if (sampleLight(p, n, wo, mat, sampler, shadow) &&
+          hit<HitQuery::Any>(shadow.ray, shadow.maxT).sphere == nullptr) {
+        radiance += throughput * shadow.radiance;
+      }
+
+      BsdfSample sample = sampleBsdf(mat, n, wo, sampler);
+      if (!survive(throughput, sample.weight, bounce, sampler)) {
+        break;
+      }
+
+      // A path out of depth ends before its next hit would be shaded, so
+      // that hit isn't traced.
+      if (depth <= 1.0f) {
+        break;
+      }
+
+      previous = {p, sample.delta ? 0.0f : sample.pdf};
+      ray = Ray{p, sample.direction};
+      record = hit(ray);
+    }
+
+    return radiance;
+  }
+
+  // Emission of mat on sphere, reached by a BSDF sample from previous. MIS
+  // weighted when sampleLight() could have picked the same direction.
+  glm::vec3 emitted(const Material &mat, const Sphere &sphere,
+                    const PathVertex &previous) const {
+    if (mat.emission == glm::vec3{0.0f} || previous.pdf <= 0.0f) {
+      return mat.emission;
+    }
+    return mat.emission *
+           powerHeuristic(previous.pdf, lightPdf(previous.point, sphere));
+  }
+
+  // Next-event estimation: picks a light uniformly, and a direction in the
+  // cone it subtends from p, and fills shadow with its MIS-weighted
+  // contribution. False when there is nothing to add, which includes delta
+  // surfaces. Always draws one 1D and one 2D sample, whatever it returns,
+  // so the sampler dimensions of later bounces don't depend on the
+  // materials hit.
+  bool sampleLight(const glm::vec3 &p, const glm::vec3 &n,
+                   const glm::vec3 &wo, const Material &mat, Sampler &sampler,
+                   ShadowRay &shadow) const {
+    float pick = sampler.next1D();
+    glm::vec2 u = sampler.next2D();
+
+    if (lights.empty() || isDelta(mat)) {
+      return false;
+    }
+
+    uint32_t count = static_cast<uint32_t>(lights.size());
+    const Sphere &light =
+        lights[glm::min(static_cast<uint32_t>(pick * count), count - 1)];
+
+    float oneMinusCosMax;
+    glm::vec3 toLight = light.center - p;
+    if (!subtends(p, light, oneMinusCosMax)) {
+      return false;
+    }
+
+    Ray ray{p, glm::normalize(uniformCone(glm::normalize(toLight),
+                                          oneMinusCosMax, u))};
+    float t = ray.intersects(light, 0.0f,
+                             std::numeric_limits<float>::infinity());
+    if (t <= 0.0f) {
+      return false;
+    }
+
+    float bsdfPdf;
+    glm::vec3 f = evalBsdf(mat, n, wo, ray.direction, bsdfPdf);
+    if (f == glm::vec3{0.0f}) {
+      return false;
+    }
+
+    float pdf = 1.0f / (glm::two_pi<float>() * oneMinusCosMax * count);
+    shadow = {ray, t * (1.0f - shadowEpsilon),
+              f * materials[light.material].emission *
+                  (powerHeuristic(pdf, bsdfPdf) / pdf)};
+    return true;
+  }
+
+  // Solid-angle density of sampleLight() choosing the direction from p to
+  // light.
+  float lightPdf(const glm::vec3 &p, const Sphere &light) const {
+    float oneMinusCosMax;
+    if (lights.empty() || !subtends(p, light, oneMinusCosMax)) {
+      return 0.0f;
+    }
+    return 1.0f / (glm::two_pi<float>() * oneMinusCosMax *
+                   static_cast<float>(lights.size()));
+  }
+
+  // 1 - cos of the half-angle light subtends from p, in a form that stays
+  // accurate for tiny angles. False from inside or on the light.
+  static bool subtends(const glm::vec3 &p, const Sphere &light,
+                       float &oneMinusCosMax) {
+    glm::vec3 toLight = light.center - p;
+    float distanceSquared = glm::dot(toLight, toLight);
+    float sinSquared = light.radius * light.radius / distanceSquared;
+    if (sinSquared >= 1.0f - 1e-4f) {
+      return false;
+    }
+
+    oneMinusCosMax = sinSquared / (1.0f + glm::sqrt(1.0f - sinSquared));
+    return true;
+  }
+
+  FirstHit firstHit(const Ray &ray, const HitRecord &record) const {
+    const Sphere *sphere = record.sphere;
+    if (sphere == nullptr) {
+      return {background(), -ray.direction};
+    }
+
+    glm::vec3 n = (ray.at(record.t) - sphere->center) / sphere->radius;
+    return {materials[sphere->material].albedo, n};
+  }
+
+  static glm::vec3 background() { return glm::vec3{0.5, 0.8, 0.9}; }
+
+  // Attenuates throughput by a BSDF sample's weight and decides whether the
+  // path goes on. Past rouletteDepth bounces a path survives with probability
+  // equal to its largest throughput component and is reweighted to stay
+  // unbiased; paths whose throughput drops below minThroughput stop early.
+  static bool survive(glm::vec3 &throughput, const glm::vec3 &weight,
+                      uint32_t bounce, Sampler &sampler) {
+    throughput *= weight;
+
+    float survival =
+        glm::max(glm::max(throughput.r, throughput.g), throughput.b);
+
+    if (survival < minThroughput) {
+      return false;
+    }
+
+    if (bounce >= rouletteDepth) {
+      survival = glm::min(survival, 0.95f);
+      if (sampler.next1D() >= survival) {
+        return false;
+      }
+      throughput /= survival;
+    }
+
+    return true;
+  }
+
+  // Closest hit by default. HitQuery::Any returns the first hit found
+  // before maxT, which is enough for shadow rays and lets traversal stop
+  // early; its t is not the nearest.
+  template <HitQuery query = HitQuery::Closest>
+  HitRecord hit(const Ray &ray,
+                float maxT = std::numeric_limits<float>::infinity()) {
+    PROFILE_SCOPE(Hit);
+    PROFILE_COUNT(Rays, 1);
+    raysTraced++;
+
+    PrimitiveHit h = bvh.hit<query>(ray, 0.001f, maxT);
+
+    if (h.index == noPrimitive) {
+      return {nullptr, h.t};
+    }
+
+    return {&spheres[h.index], h.t};
+  }
+
+  // Must be called again whenever spheres are added or removed.
+  void build() {
+    bvh.build(spheres);
+    findLights();
+  }
+
+  // Enough after spheres only moved or changed radius.
+  void refit() {
+    bvh.refit(spheres);
+    findLights();
+  }
+
+  void findLights() {
+    lights.clear();
+    for (const Sphere &sphere : spheres) {
+      if (materials[sphere.material].emission != glm::vec3{0.0f}) {
+        lights.push_back(sphere);
+      }
+    }
+  }
+};